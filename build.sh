@@ -2,4 +2,4 @@ cd spreadsheet-engine
 dos2unix inputs/*
 dos2unix outputs/*
 dos2unix ../run.sh
-g++-9 -O2 -std=c++17 -I/usr/local/Cellar/tbb/2020_U3_1/include/ -L/usr/local/Cellar/tbb/2020_U3_1/lib/ -ltbb engine.cpp reader.cpp writer.cpp solutions/fast.cpp solutions/one-thread-simple.cpp -o ../engine.out
+g++-9 -O2 -std=c++17 -I/usr/local/Cellar/tbb/2020_U3_1/include/ -L/usr/local/Cellar/tbb/2020_U3_1/lib/ -ltbb engine.cpp reader.cpp writer.cpp solutions/fast.cpp solutions/one-thread-simple.cpp solutions/tiled.cpp solutions/critical-path.cpp solutions/external-service.cpp solutions/async.cpp solutions/memo-cache.cpp mapped-file.cpp cell-ids.cpp solutions/snapshot.cpp solutions/edit-log.cpp radix-sort.cpp patched-output.cpp async-file-io.cpp solutions/columnar-export.cpp epoch-reclaimer.cpp solutions/fork.cpp solutions/scenarios.cpp solutions/formula-kernels.cpp -o ../engine.out
@@ -0,0 +1,585 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include "async-file-io.h"
+
+#ifdef _WIN32
+  #include <io.h>
+  #include <fcntl.h>
+  #include <sys/stat.h>
+#else
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+  #if __has_include(<linux/io_uring.h>)
+    #define HAS_IO_URING
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+  #endif
+#endif
+
+// -------------- File operations --------------
+
+static int open_for_writing(const std::string& file_path) {
+#ifdef _WIN32
+    return _open(file_path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    return open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+}
+
+static void close_file(int fd) {
+#ifdef _WIN32
+    _close(fd);
+#else
+    close(fd);
+#endif
+}
+
+static bool sync_file(int fd) {
+#ifdef _WIN32
+    return _commit(fd) == 0;
+#elif defined(__APPLE__)
+    return fsync(fd) == 0;
+#else
+    return fdatasync(fd) == 0;
+#endif
+}
+
+// Writes the whole buffer at the offset, or at the current position for kAppend.
+static bool write_all(int fd, uint64_t offset, const char* data, std::size_t size) {
+#ifdef _WIN32
+    if (offset != AsyncFileIO::kAppend && _lseeki64(fd, offset, SEEK_SET) < 0) {
+        return false;
+    }
+#endif
+    std::size_t written = 0;
+    while (written < size) {
+        std::size_t part = std::min<std::size_t>(size - written, 1 << 30);
+#ifdef _WIN32
+        int result = _write(fd, data + written, (unsigned int) part);
+#else
+        ssize_t result = offset == AsyncFileIO::kAppend ? write(fd, data + written, part)
+                                                       : pwrite(fd, data + written, part, offset + written);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+#endif
+        if (result <= 0) {
+            return false;
+        }
+        written += result;
+    }
+    return true;
+}
+
+// -------------- io_uring --------------
+
+struct AsyncFileIO::IoUring {
+#ifdef HAS_IO_URING
+    static const unsigned kEntries = 64;
+
+    int fd = -1;
+    unsigned sq_entries = 0;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    void* sq_ring = MAP_FAILED;
+    std::size_t sq_ring_size = 0;
+    void* cq_ring = MAP_FAILED;
+    std::size_t cq_ring_size = 0;
+    std::size_t sqes_size = 0;
+
+    // Submission queue is filled under the mutex. Callers wait while too many operations are in flight,
+    // completions of the reaper thread never wait.
+    std::mutex submit_mutex;
+    std::condition_variable has_space;
+    unsigned in_flight = 0;
+
+    // Completions which are taken from the queue by the reaper thread under submit_mutex, the reaper handles them
+    // after it releases the mutex. reaped_count is the number of all taken completions.
+    std::vector<std::pair<uint64_t, int>> reaped_events;
+    uint64_t reaped_count = 0;
+    bool is_stopped = false;
+
+    ~IoUring() {
+        if (sqes != nullptr) {
+            munmap(sqes, sqes_size);
+        }
+        if (cq_ring != MAP_FAILED && cq_ring != sq_ring) {
+            munmap(cq_ring, cq_ring_size);
+        }
+        if (sq_ring != MAP_FAILED) {
+            munmap(sq_ring, sq_ring_size);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    void Push(uint8_t opcode, int file, const void* data, std::size_t size, uint64_t offset, uint64_t user_data) {
+        unsigned tail = *sq_tail;
+        unsigned index = tail & *sq_mask;
+        io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = opcode;
+        sqe->fd = file;
+        sqe->addr = (uint64_t) data;
+        // Longer writes are short, the rest is written by the reaper.
+        sqe->len = (unsigned) std::min<std::size_t>(size, 1 << 30);
+        sqe->off = offset;
+        sqe->user_data = user_data;
+        if (opcode == IORING_OP_FSYNC) {
+            sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        }
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    // Without SQPOLL the kernel consumes pushed entries only in io_uring_enter(). 'count' is decreased by the number
+    // of consumed entries, returns 0 or the error which stopped the submission.
+    int Enter(unsigned& count) {
+        while (count > 0) {
+            long result = syscall(__NR_io_uring_enter, fd, count, 0, 0, nullptr, 0);
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result <= 0) {
+                return result < 0 ? errno : EAGAIN;
+            }
+            count -= (unsigned) result;
+        }
+        return 0;
+    }
+
+    // Takes back the last pushed entries which were not consumed by the kernel.
+    void Unpush(unsigned count) {
+        __atomic_store_n(sq_tail, *sq_tail - count, __ATOMIC_RELEASE);
+    }
+
+    // Only the reaper thread reads the completion queue, under submit_mutex.
+    void Reap() {
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        unsigned count = tail - head;
+        for (; head != tail; head++) {
+            const io_uring_cqe& cqe = cqes[head & *cq_mask];
+            reaped_events.emplace_back(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        in_flight -= count;
+        reaped_count += count;
+    }
+#endif
+};
+
+bool AsyncFileIO::SetupIoUring() {
+#ifdef HAS_IO_URING
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    auto new_ring = std::make_unique<IoUring>();
+    new_ring->fd = (int) syscall(__NR_io_uring_setup, IoUring::kEntries, &params);
+    // Writes at the current position appeared together with IORING_OP_WRITE, older kernels use the thread pool.
+    if (new_ring->fd < 0 || !(params.features & IORING_FEAT_RW_CUR_POS)) {
+        return false;
+    }
+
+    IoUring& r = *new_ring;
+    r.sq_entries = params.sq_entries;
+    r.sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    r.cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        r.sq_ring_size = r.cq_ring_size = std::max(r.sq_ring_size, r.cq_ring_size);
+    }
+    r.sq_ring = mmap(nullptr, r.sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r.fd, IORING_OFF_SQ_RING);
+    if (r.sq_ring == MAP_FAILED) {
+        return false;
+    }
+    r.cq_ring = single_mmap ? r.sq_ring
+                            : mmap(nullptr, r.cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r.fd, IORING_OFF_CQ_RING);
+    if (r.cq_ring == MAP_FAILED) {
+        return false;
+    }
+    r.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, r.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r.fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        return false;
+    }
+    r.sqes = (io_uring_sqe*) sqes;
+
+    char* sq = (char*) r.sq_ring;
+    char* cq = (char*) r.cq_ring;
+    r.sq_tail = (unsigned*) (sq + params.sq_off.tail);
+    r.sq_mask = (unsigned*) (sq + params.sq_off.ring_mask);
+    r.sq_array = (unsigned*) (sq + params.sq_off.array);
+    r.cq_head = (unsigned*) (cq + params.cq_off.head);
+    r.cq_tail = (unsigned*) (cq + params.cq_off.tail);
+    r.cq_mask = (unsigned*) (cq + params.cq_off.ring_mask);
+    r.cqes = (io_uring_cqe*) (cq + params.cq_off.cqes);
+
+    ring = std::move(new_ring);
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Writes at known offsets are submitted at once. In append mode buffers are written one by one,
+// every next one is submitted by the reaper when the previous one is completed.
+void AsyncFileIO::SubmitToIoUring(Request* request) {
+    std::size_t buffers_count = request->buffers.size();
+    request->operations.resize(buffers_count + 1);
+    uint64_t offset = request->offset;
+    for (std::size_t i = 0; i <= buffers_count; i++) {
+        request->operations[i] = { request, i, offset };
+        if (offset != kAppend && i < buffers_count) {
+            offset += request->buffers[i].size;
+        }
+    }
+
+    std::vector<Operation*> operations;
+    if (buffers_count == 0) {
+        if (!request->sync) {
+            Complete(request);
+            return;
+        }
+        request->is_syncing = true;
+        operations.push_back(&request->operations[0]);
+    } else if (request->offset == kAppend) {
+        request->next_buffer = 1;
+        operations.push_back(&request->operations[0]);
+    } else {
+        request->next_buffer = buffers_count;
+        for (std::size_t i = 0; i < buffers_count; i++) {
+            operations.push_back(&request->operations[i]);
+        }
+    }
+    request->pending = (int) operations.size();
+    SubmitOperations(operations);
+}
+
+// The kernel can be short of memory for requests (EAGAIN) or completions (EBUSY): entries which were not consumed
+// are taken back, completions are reaped and the rest is submitted again. Other errors fail requests of operations
+// which were not submitted, the next requests go to the thread pool.
+void AsyncFileIO::SubmitOperations(const std::vector<Operation*>& operations) {
+#ifdef HAS_IO_URING
+    bool is_reaper = std::this_thread::get_id() == reaper.get_id();
+    std::size_t submitted = 0;
+    int error = 0;
+    while (submitted < operations.size()) {
+        std::unique_lock<std::mutex> lock(ring->submit_mutex);
+        unsigned count = (unsigned) std::min<std::size_t>(operations.size() - submitted, ring->sq_entries);
+        if (!is_reaper) {
+            ring->has_space.wait(lock, [&]() { return ring->in_flight + count <= ring->sq_entries; });
+        }
+        for (unsigned i = 0; i < count; i++) {
+            Operation* operation = operations[submitted + i];
+            Request* request = operation->request;
+            if (operation->index < request->buffers.size()) {
+                const Buffer& buffer = request->buffers[operation->index];
+                ring->Push(IORING_OP_WRITE, request->fd, buffer.data, buffer.size, operation->offset, (uint64_t) operation);
+            } else {
+                ring->Push(IORING_OP_FSYNC, request->fd, nullptr, 0, 0, (uint64_t) operation);
+            }
+        }
+        ring->in_flight += count;
+        unsigned remaining = count;
+        error = ring->Enter(remaining);
+        submitted += count - remaining;
+        if (error == 0) {
+            continue;
+        }
+        ring->Unpush(remaining);
+        ring->in_flight -= remaining;
+        if (error != EAGAIN && error != EBUSY) {
+            break;
+        }
+        // The reaper takes completions itself, other threads wait until it takes some (or for a while if
+        // nothing is in flight).
+        if (is_reaper) {
+            ring->Reap();
+        } else {
+            uint64_t reaped = ring->reaped_count;
+            ring->has_space.wait_for(lock, std::chrono::milliseconds(1), [&]() { return ring->reaped_count != reaped; });
+        }
+        error = 0;
+    }
+    if (error == 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!is_ring_failed) {
+            is_ring_failed = true;
+            StartPool();
+        }
+    }
+    for (std::size_t i = submitted; i < operations.size(); i++) {
+        HandleCompletion(operations[i], -error);
+    }
+#endif
+}
+
+void AsyncFileIO::HandleCompletion(Operation* operation, int result) {
+    Request* request = operation->request;
+    if (operation->index < request->buffers.size()) {
+        const Buffer& buffer = request->buffers[operation->index];
+        if (result < 0) {
+            request->ok = false;
+        } else if ((std::size_t) result < buffer.size) {
+            uint64_t offset = operation->offset == kAppend ? kAppend : operation->offset + result;
+            request->ok = request->ok && write_all(request->fd, offset, (const char*) buffer.data + result, buffer.size - result);
+        }
+    } else if (result < 0) {
+        request->ok = false;
+    }
+    if (--request->pending > 0) {
+        return;
+    }
+
+    if (request->ok && request->next_buffer < request->buffers.size()) {
+        request->pending = 1;
+        SubmitOperations({ &request->operations[request->next_buffer++] });
+    } else if (request->ok && request->sync && !request->is_syncing) {
+        request->is_syncing = true;
+        request->pending = 1;
+        SubmitOperations({ &request->operations.back() });
+    } else {
+        Complete(request);
+    }
+}
+
+// Operation with zero user data stops the thread (or a failed wait after the destructor started). Completions which were taken by SubmitOperations() are handled
+// before the next wait.
+void AsyncFileIO::ReaperThreadJob() {
+#ifdef HAS_IO_URING
+    std::vector<std::pair<uint64_t, int>> events;
+    while (true) {
+        bool has_events;
+        {
+            std::lock_guard<std::mutex> lock(ring->submit_mutex);
+            has_events = !ring->reaped_events.empty();
+        }
+        // Errors (EINTR, EBUSY) only end the wait early, the queue is read in any case.
+        bool is_failed = false;
+        if (!has_events) {
+            is_failed = syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR;
+        }
+
+        events.clear();
+        {
+            std::lock_guard<std::mutex> lock(ring->submit_mutex);
+            ring->Reap();
+            events.swap(ring->reaped_events);
+            if (is_failed && ring->is_stopped && events.empty()) {
+                return;
+            }
+        }
+        ring->has_space.notify_all();
+
+        bool stop = false;
+        for (const auto& it : events) {
+            if (it.first == 0) {
+                stop = true;
+            } else {
+                HandleCompletion((Operation*) it.first, it.second);
+            }
+        }
+        if (stop) {
+            return;
+        }
+    }
+#endif
+}
+
+// -------------- Thread pool --------------
+
+// Called under the mutex.
+void AsyncFileIO::StartPool() {
+    for (int i = 0; i < kPoolThreadsCount; i++) {
+        pool.emplace_back([&]() { PoolThreadJob(); });
+    }
+}
+
+bool AsyncFileIO::WriteBlocking(Request& request) {
+    uint64_t offset = request.offset;
+    for (const auto& it : request.buffers) {
+        if (!write_all(request.fd, offset, (const char*) it.data, it.size)) {
+            return false;
+        }
+        if (offset != kAppend) {
+            offset += it.size;
+        }
+    }
+    return !request.sync || sync_file(request.fd);
+}
+
+void AsyncFileIO::PoolThreadJob() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        pool_has_requests.wait(lock, [&]() { return !pool_queue.empty() || stopped; });
+        if (pool_queue.empty()) {
+            return;
+        }
+        Request* request = pool_queue.front();
+        pool_queue.pop_front();
+        lock.unlock();
+        request->ok = WriteBlocking(*request);
+        Complete(request);
+        lock.lock();
+    }
+}
+
+// ----------------------------
+
+AsyncFileIO::AsyncFileIO(bool use_io_uring) {
+    if (use_io_uring && SetupIoUring()) {
+        reaper = std::thread([&]() { ReaperThreadJob(); });
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    StartPool();
+}
+
+AsyncFileIO::~AsyncFileIO() {
+    WaitAll();
+#ifdef HAS_IO_URING
+    if (ring) {
+        // The stop operation is submitted again while the kernel is short of memory. If it fails otherwise,
+        // the ring is broken and the wait of the reaper fails too, so it stops by the flag.
+        std::unique_lock<std::mutex> lock(ring->submit_mutex);
+        ring->is_stopped = true;
+        while (true) {
+            ring->Push(IORING_OP_NOP, -1, nullptr, 0, 0, 0);
+            unsigned count = 1;
+            int error = ring->Enter(count);
+            if (error == 0) {
+                ring->in_flight++;
+                break;
+            }
+            ring->Unpush(1);
+            if (error != EAGAIN && error != EBUSY) {
+                break;
+            }
+            lock.unlock();
+            std::this_thread::yield();
+            lock.lock();
+        }
+        lock.unlock();
+        reaper.join();
+    }
+#endif
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopped = true;
+    }
+    pool_has_requests.notify_all();
+    for (auto& it : pool) {
+        it.join();
+    }
+}
+
+uint64_t AsyncFileIO::Submit(std::unique_ptr<Request> request) {
+    Request* pointer = request.get();
+    uint64_t id;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        id = ++last_request;
+        requests.emplace(id, std::move(request));
+        if (pointer->fd < 0) {
+            pointer->ok = false;
+            pointer->done = true;
+            return id;
+        }
+        if (!ring || is_ring_failed) {
+            pool_queue.push_back(pointer);
+            pool_has_requests.notify_one();
+            return id;
+        }
+    }
+    SubmitToIoUring(pointer);
+    return id;
+}
+
+void AsyncFileIO::Complete(Request* request) {
+    if (request->owns_fd) {
+        close_file(request->fd);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    request->owner.reset();
+    request->done = true;
+    request_done.notify_all();
+}
+
+uint64_t AsyncFileIO::Write(int fd, uint64_t offset, std::vector<Buffer> buffers, bool sync, std::shared_ptr<const void> owner) {
+    auto request = std::make_unique<Request>();
+    request->fd = fd;
+    request->owns_fd = false;
+    request->offset = offset;
+    request->sync = sync;
+    request->buffers = std::move(buffers);
+    request->owner = std::move(owner);
+    return Submit(std::move(request));
+}
+
+uint64_t AsyncFileIO::WriteFile(const std::string& file_path, std::vector<Buffer> buffers, bool sync,
+                                std::shared_ptr<const void> owner) {
+    auto request = std::make_unique<Request>();
+    request->fd = open_for_writing(file_path);
+    request->owns_fd = request->fd >= 0;
+    request->offset = 0;
+    request->sync = sync;
+    request->buffers = std::move(buffers);
+    request->owner = std::move(owner);
+    return Submit(std::move(request));
+}
+
+uint64_t AsyncFileIO::WriteFile(const std::string& file_path, std::vector<std::string> buffers, bool sync) {
+    auto strings = std::make_shared<std::vector<std::string>>(std::move(buffers));
+    std::vector<Buffer> views;
+    views.reserve(strings->size());
+    for (const auto& it : *strings) {
+        views.push_back({ it.data(), it.size() });
+    }
+    return WriteFile(file_path, std::move(views), sync, strings);
+}
+
+bool AsyncFileIO::Wait(uint64_t request) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto it = requests.find(request);
+    if (it == requests.end()) {
+        return false;
+    }
+    Request* pointer = it->second.get();
+    request_done.wait(lock, [&]() { return pointer->done; });
+    bool ok = pointer->ok;
+    requests.erase(request);
+    return ok;
+}
+
+bool AsyncFileIO::WaitAll() {
+    std::vector<uint64_t> ids;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& it : requests) {
+            ids.push_back(it.first);
+        }
+    }
+    bool ok = true;
+    for (uint64_t id : ids) {
+        ok = Wait(id) && ok;
+    }
+    return ok;
+}
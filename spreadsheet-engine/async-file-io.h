@@ -0,0 +1,120 @@
+#ifndef SPREADSHEETENGINE_ASYNC_FILE_IO_H
+#define SPREADSHEETENGINE_ASYNC_FILE_IO_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Asynchronous writes of whole buffers. A request is submitted and its completion is waited later,
+// so I/O overlaps with the work which is done in between.
+//
+// On Linux requests go to io_uring by raw system calls (liburing is not needed): all buffers of a request are
+// written by the kernel straight from memory of the caller, fsync is submitted after the last write is completed.
+// Other systems and kernels without io_uring use a pool of threads with blocking writes. If io_uring fails to submit
+// operations, their requests fail and the next requests go to the pool too.
+class AsyncFileIO {
+public:
+    // Memory of a buffer should be alive until the request is completed.
+    struct Buffer {
+        const void* data;
+        std::size_t size;
+    };
+
+    // Offset which means the current position of the file, buffers are written one after another.
+    static const uint64_t kAppend = ~0ull;
+
+    explicit AsyncFileIO(bool use_io_uring = true);
+    // Waits for all requests.
+    ~AsyncFileIO();
+
+    AsyncFileIO(const AsyncFileIO&) = delete;
+    AsyncFileIO& operator=(const AsyncFileIO&) = delete;
+
+    // Writes buffers one after another from 'offset' of the open file and syncs data of the file if 'sync' is true.
+    // 'owner' is released when the request is completed, it can keep memory of buffers alive. Returns the request id.
+    // Requests to the same file descriptor should not overlap.
+    uint64_t Write(int fd, uint64_t offset, std::vector<Buffer> buffers, bool sync, std::shared_ptr<const void> owner = nullptr);
+
+    // Creates or truncates the file, writes buffers from its beginning and closes it.
+    uint64_t WriteFile(const std::string& file_path, std::vector<Buffer> buffers, bool sync,
+                       std::shared_ptr<const void> owner = nullptr);
+    // Strings are owned by the request, they are not copied.
+    uint64_t WriteFile(const std::string& file_path, std::vector<std::string> buffers, bool sync);
+
+    // Returns false if the request failed or there is no such request. Every request should be waited once.
+    bool Wait(uint64_t request);
+    // Waits for all requests which are not waited yet. Returns false if any of them failed.
+    bool WaitAll();
+
+    bool UsesIoUring() const { return ring != nullptr; }
+
+private:
+    struct Request;
+
+    // Write of one buffer or fsync (index is the number of buffers), it is user data of io_uring operation.
+    struct Operation {
+        Request* request;
+        std::size_t index;
+        uint64_t offset;
+    };
+
+    struct Request {
+        int fd;
+        bool owns_fd;
+        uint64_t offset;
+        bool sync;
+        std::vector<Buffer> buffers;
+        std::shared_ptr<const void> owner;
+
+        // Used by io_uring: operations in flight, the next buffer in append mode and sync state.
+        // Failed submissions are handled by the submitting thread, so 'pending' and 'ok' are atomic.
+        std::vector<Operation> operations;
+        std::atomic<int> pending{0};
+        std::size_t next_buffer = 0;
+        bool is_syncing = false;
+
+        std::atomic<bool> ok{true};
+        bool done = false;
+    };
+
+    struct IoUring;
+
+    std::mutex mutex;
+    std::condition_variable request_done;
+    std::unordered_map<uint64_t, std::unique_ptr<Request>> requests;
+    uint64_t last_request = 0;
+
+    // io_uring, nullptr if it is not used. The reaper thread handles completions.
+    std::unique_ptr<IoUring> ring;
+    std::thread reaper;
+    bool is_ring_failed = false;
+
+    // Thread pool
+    static const int kPoolThreadsCount = 2;
+    std::vector<std::thread> pool;
+    std::deque<Request*> pool_queue;
+    std::condition_variable pool_has_requests;
+    bool stopped = false;
+
+    uint64_t Submit(std::unique_ptr<Request> request);
+    void Complete(Request* request);
+
+    void StartPool();
+    void PoolThreadJob();
+    static bool WriteBlocking(Request& request);
+
+    bool SetupIoUring();
+    void SubmitToIoUring(Request* request);
+    void SubmitOperations(const std::vector<Operation*>& operations);
+    void HandleCompletion(Operation* operation, int result);
+    void ReaperThreadJob();
+};
+
+#endif //SPREADSHEETENGINE_ASYNC_FILE_IO_H
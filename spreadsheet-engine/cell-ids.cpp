@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+
+#include "cell-ids.h"
+
+const int CellIds::kNoKey;
+
+CellIds::CellIds() : pages(new std::atomic<Page*>[kPagesCount]) {
+    for (int i = 0; i < kPagesCount; i++) {
+        pages[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+CellIds::~CellIds() {
+    Clear();
+}
+
+int CellIds::GetKey(std::string_view name) {
+    // Rows less than kMaxRows have at most 7 digits.
+    if (name.size() < 2 || name.size() > 8 || name[0] < 'A' || name[0] > 'Z' || (name[1] == '0' && name.size() > 2)) {
+        return -1;
+    }
+    int row = 0;
+    for (std::size_t i = 1; i < name.size(); i++) {
+        if (name[i] < '0' || name[i] > '9') {
+            return -1;
+        }
+        row = row * 10 + (name[i] - '0');
+    }
+    if (row >= kMaxRows) {
+        return -1;
+    }
+    return (name[0] - 'A') * kMaxRows + row;
+}
+
+uint64_t CellIds::ParseSortKey(std::string_view name) {
+    uint64_t row = 0;
+    for (std::size_t i = 1; i < name.size() && row <= UINT32_MAX; i++) {
+        row = row * 10 + (name[i] - '0');
+    }
+    return (uint64_t) (unsigned char) (name[0] - 'A') << 32 | std::min<uint64_t>(row, UINT32_MAX);
+}
+
+int CellIds::AddOtherName(std::string_view name) {
+    if (!free_other_names.empty()) {
+        int index = free_other_names.back();
+        free_other_names.pop_back();
+        other_names[index] = name;
+        other_sort_keys[index] = ParseSortKey(name);
+        return index;
+    }
+    other_names.emplace_back(name);
+    other_sort_keys.push_back(ParseSortKey(name));
+    return other_names.size() - 1;
+}
+
+std::atomic<int>& CellIds::GetSlot(int key) {
+    std::atomic<Page*>& page = pages[key >> kPageBits];
+    Page* current = page.load(std::memory_order_acquire);
+    if (current == nullptr) {
+        Page* new_page = new Page();
+        if (page.compare_exchange_strong(current, new_page, std::memory_order_acq_rel)) {
+            current = new_page;
+        } else {
+            delete new_page;
+        }
+    }
+    return current->ids[key & (kPageSize - 1)];
+}
+
+const std::atomic<int>* CellIds::FindSlot(int key) const {
+    Page* page = pages[key >> kPageBits].load(std::memory_order_acquire);
+    return page != nullptr ? &page->ids[key & (kPageSize - 1)] : nullptr;
+}
+
+void CellIds::SetKey(int id, int key) {
+    if ((std::size_t) id >= key_by_id.size()) {
+        key_by_id.resize(id + 1, kNoKey);
+    }
+    key_by_id[id] = key;
+}
+
+int CellIds::Intern(std::string_view name) {
+    int key = GetKey(name);
+    if (key >= 0) {
+        std::atomic<int>& slot = GetSlot(key);
+        int id = slot.load(std::memory_order_acquire);
+        if (id != -1) {
+            return id;
+        }
+
+        // New cells get ids one by one
+        std::lock_guard<std::mutex> lock(other_mutex);
+        id = slot.load(std::memory_order_acquire);
+        if (id == -1) {
+            id = size.load();
+            SetKey(id, key);
+            slot.store(id, std::memory_order_release);
+            size++;
+        }
+        return id;
+    }
+
+    std::lock_guard<std::mutex> lock(other_mutex);
+    auto it = other_ids.find(std::string(name));
+    if (it != other_ids.end()) {
+        return it->second;
+    }
+    int id = size.load();
+    other_ids.emplace(name, id);
+    SetKey(id, -1 - AddOtherName(name));
+    size++;
+    return id;
+}
+
+bool CellIds::Insert(std::string_view name, int id) {
+    int key = GetKey(name);
+    if (key >= 0) {
+        int expected = -1;
+        if (!GetSlot(key).compare_exchange_strong(expected, id, std::memory_order_acq_rel)) {
+            return false;
+        }
+    } else {
+        std::lock_guard<std::mutex> lock(other_mutex);
+        if (!other_ids.emplace(name, id).second) {
+            return false;
+        }
+        key = -1 - AddOtherName(name);
+    }
+    SetKey(id, key);
+    size++;
+    return true;
+}
+
+void CellIds::Remove(int id) {
+    int key = key_by_id[id];
+    if (key == kNoKey) {
+        return;
+    }
+    if (key >= 0) {
+        GetSlot(key).store(-1, std::memory_order_release);
+    } else {
+        std::lock_guard<std::mutex> lock(other_mutex);
+        other_ids.erase(other_names[-1 - key]);
+        other_names[-1 - key].clear();
+        free_other_names.push_back(-1 - key);
+    }
+    key_by_id[id] = kNoKey;
+    size--;
+}
+
+int CellIds::Find(std::string_view name) const {
+    int key = GetKey(name);
+    if (key >= 0) {
+        const std::atomic<int>* slot = FindSlot(key);
+        return slot != nullptr ? slot->load(std::memory_order_acquire) : -1;
+    }
+    std::lock_guard<std::mutex> lock(other_mutex);
+    auto it = other_ids.find(std::string(name));
+    return it != other_ids.end() ? it->second : -1;
+}
+
+std::string CellIds::GetName(int id) const {
+    int key = key_by_id[id];
+    if (key == kNoKey) {
+        return std::string();
+    }
+    if (key < 0) {
+        return other_names[-1 - key];
+    }
+    std::string name(1, char('A' + key / kMaxRows));
+    name += std::to_string(key % kMaxRows);
+    return name;
+}
+
+void CellIds::AppendName(int id, std::string& buffer) const {
+    int key = key_by_id[id];
+    if (key == kNoKey) {
+        return;
+    }
+    if (key < 0) {
+        buffer += other_names[-1 - key];
+        return;
+    }
+    char name[8];
+    name[0] = char('A' + key / kMaxRows);
+    buffer.append(name, std::to_chars(name + 1, name + sizeof(name), key % kMaxRows).ptr);
+}
+
+void CellIds::GetPosition(int id, int& column, int& row) const {
+    int key = key_by_id[id];
+    if (key == kNoKey) {
+        column = row = -1;
+        return;
+    }
+    if (key < 0) {
+        const std::string& name = other_names[-1 - key];
+        column = name[0] - 'A';
+        row = std::atoi(name.c_str() + 1);
+        return;
+    }
+    column = key / kMaxRows;
+    row = key % kMaxRows;
+}
+
+uint64_t CellIds::GetSortKey(int id) const {
+    int key = key_by_id[id];
+    if (key == kNoKey) {
+        return UINT64_MAX;
+    }
+    if (key < 0) {
+        return other_sort_keys[-1 - key];
+    }
+    return (uint64_t) (key / kMaxRows) << 32 | (key % kMaxRows);
+}
+
+void CellIds::Reserve(std::size_t count) {
+    if (key_by_id.size() < count) {
+        key_by_id.resize(count, kNoKey);
+    }
+}
+
+void CellIds::Clear() {
+    for (int i = 0; i < kPagesCount; i++) {
+        delete pages[i].exchange(nullptr);
+    }
+    other_ids.clear();
+    other_names.clear();
+    other_sort_keys.clear();
+    free_other_names.clear();
+    key_by_id.clear();
+    size = 0;
+}
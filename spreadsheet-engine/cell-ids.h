@@ -0,0 +1,108 @@
+#ifndef SPREADSHEETENGINE_CELL_IDS_H
+#define SPREADSHEETENGINE_CELL_IDS_H
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Table of cell ids by cell name without hashing of names.
+//
+// Canonical name (a column letter and a row number without leading zeros) is mapped to the key
+// column * kMaxRows + row arithmetically. Ids are stored by key in a two-level table: a page of kPageSize ids
+// is allocated only when some row of its range is used, so sparse sheets don't waste memory.
+// Other names (leading zeros, rows greater than kMaxRows) are kept in a hash map.
+//
+// Name of a cell is restored from its key, so only one integer per cell is stored for the reverse mapping.
+// The key also gives the output order (column letter, then numeric row) of the cell.
+class CellIds {
+public:
+    CellIds();
+    ~CellIds();
+
+    CellIds(const CellIds&) = delete;
+    CellIds& operator=(const CellIds&) = delete;
+
+    // Returns id of the cell, a new cell gets id equal to the number of cells.
+    int Intern(std::string_view name);
+
+    // Adds the cell with the given id. Returns false if the cell already exists.
+    // Can run in parallel with other Insert() calls if ids are less than the reserved count.
+    bool Insert(std::string_view name, int id);
+
+    // Removes the cell, its id can be given to another cell by Insert(). Intern() should not be used after Remove(),
+    // because it gives the id equal to the number of cells.
+    void Remove(int id);
+
+    // Returns -1 if there is no such cell. Can run in parallel with other Find() calls and with one thread
+    // which calls Insert() and Remove() for ids less than the reserved count.
+    int Find(std::string_view name) const;
+
+    // Name of a removed or never added id is empty.
+    std::string GetName(int id) const;
+    // Appends the name to the buffer, canonical names are formatted without temporary strings.
+    void AppendName(int id, std::string& buffer) const;
+    // Column and row of the cell, column is 0 for 'A'.
+    void GetPosition(int id, int& column, int& row) const;
+    // Column in high 32 bits, row in low 32 bits. Sorting by this key gives the order of output files.
+    uint64_t GetSortKey(int id) const;
+
+    // Makes room for names of 'count' cells.
+    void Reserve(std::size_t count);
+    void Clear();
+
+    std::size_t Size() const { return size.load(); }
+
+private:
+    static const int kColumnsCount = 26;
+    // The same number of rows as a sheet of Excel has.
+    static const int kMaxRows = 1 << 20;
+    static const int kPageBits = 12;
+    static const int kPageSize = 1 << kPageBits;
+    static const int kPagesCount = kColumnsCount * (kMaxRows / kPageSize);
+
+    struct Page {
+        Page() {
+            for (auto& it : ids) {
+                it.store(-1, std::memory_order_relaxed);
+            }
+        }
+
+        std::atomic<int> ids[kPageSize];
+    };
+
+    // Page is allocated by the thread which uses it first, pages are never moved.
+    std::unique_ptr<std::atomic<Page*>[]> pages;
+
+    // Key of ids which don't have a name.
+    static const int kNoKey = std::numeric_limits<int>::min();
+
+    // Names which don't have a key. Entries of removed names are reused.
+    mutable std::mutex other_mutex;
+    std::unordered_map<std::string, int> other_ids;
+    std::vector<std::string> other_names;
+    // Sort keys of other names are parsed once, when a name is added.
+    std::vector<uint64_t> other_sort_keys;
+    std::vector<int> free_other_names;
+
+    // Key of the cell by id, -1 - i for the i-th of other names.
+    std::vector<int> key_by_id;
+    std::atomic<std::size_t> size{0};
+
+    // Returns -1 if the name is not canonical.
+    static int GetKey(std::string_view name);
+    static uint64_t ParseSortKey(std::string_view name);
+    // Returns the index of the name in other_names.
+    int AddOtherName(std::string_view name);
+
+    std::atomic<int>& GetSlot(int key);
+    const std::atomic<int>* FindSlot(int key) const;
+    void SetKey(int id, int key);
+};
+
+#endif //SPREADSHEETENGINE_CELL_IDS_H
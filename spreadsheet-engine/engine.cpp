@@ -1,13 +1,119 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <execution>
 #include <iostream>
+#include <new>
+#include <numeric>
+#include <random>
 #include <thread>
 #include "reader.h"
+#include "mapped-file.h"
 #include "io-data.h"
 #include "utils.h"
 #include "solutions/one-thread-simple.h"
 #include "solutions/fast.h"
+#include "solutions/formula-kernels.h"
+#include "solutions/scenarios.h"
+#include "solutions/tiled.h"
+#include "solutions/critical-path.h"
+#include "solutions/async.h"
+#include "solutions/edit-log.h"
 #include "writer.h"
+#include "patched-output.h"
+#include "async-file-io.h"
+#include "solutions/columnar-export.h"
 #include "solutions/solution.h"
 
+// -------------- Allocation counting --------------
+
+// Global operator new keeps the size of a block and the number of the counting session in front of it,
+// so allocations and the peak of allocated memory can be counted for a part of the program.
+// Memory of TBB containers is not counted. The header and atomics slow down every allocation of the process,
+// so counting is compiled only with COUNT_ALLOCATIONS defined, otherwise AllocationCounter does nothing.
+#ifdef COUNT_ALLOCATIONS
+namespace allocations {
+    std::atomic<uint64_t> session{0};
+    std::atomic<uint64_t> count{0};
+    std::atomic<int64_t> current_bytes{0};
+    std::atomic<int64_t> peak_bytes{0};
+}
+
+struct AllocationHeader {
+    std::size_t size;
+    uint64_t session;
+};
+static_assert(sizeof(AllocationHeader) % alignof(std::max_align_t) == 0, "header breaks alignment of blocks");
+
+void* operator new(std::size_t size) {
+    AllocationHeader* header = (AllocationHeader*) std::malloc(sizeof(AllocationHeader) + size);
+    if (header == nullptr) {
+        throw std::bad_alloc();
+    }
+    header->size = size;
+    header->session = allocations::session.load(std::memory_order_relaxed);
+    if (header->session % 2 == 1) {
+        allocations::count.fetch_add(1, std::memory_order_relaxed);
+        int64_t current = allocations::current_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+        int64_t peak = allocations::peak_bytes.load(std::memory_order_relaxed);
+        while (current > peak && !allocations::peak_bytes.compare_exchange_weak(peak, current, std::memory_order_relaxed)) {
+        }
+    }
+    return header + 1;
+}
+
+void operator delete(void* p) noexcept {
+    if (p == nullptr) {
+        return;
+    }
+    AllocationHeader* header = (AllocationHeader*) p - 1;
+    if (header->session % 2 == 1 && header->session == allocations::session.load(std::memory_order_relaxed)) {
+        allocations::current_bytes.fetch_sub(header->size, std::memory_order_relaxed);
+    }
+    std::free(header);
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete[](void* p) noexcept {
+    operator delete(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    operator delete(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    operator delete(p);
+}
+
+#endif
+
+// Counts allocations from construction to destruction, odd session number means that counting is on.
+class AllocationCounter {
+public:
+#ifdef COUNT_ALLOCATIONS
+    explicit AllocationCounter(std::string message) : message(std::move(message)) {
+        allocations::count = 0;
+        allocations::current_bytes = 0;
+        allocations::peak_bytes = 0;
+        allocations::session += 1;
+    }
+    ~AllocationCounter() {
+        allocations::session += 1;
+        std::cout << message << allocations::count.load() << " allocations, peak "
+                  << allocations::peak_bytes.load() / (1 << 20) << " MB" << std::endl;
+    }
+
+private:
+    std::string message;
+#else
+    explicit AllocationCounter(const std::string&) {}
+#endif
+};
+
 // Compare two files and print detailed message if they are not equal.
 inline bool check_correctness(const std::string& correct_file, const std::string& actual_file) {
 
@@ -31,8 +137,8 @@ bool write_and_check(Solution& solution, const std::string& output_path, const s
     bool compare_to_correct_solution = correct_solution_name.length() > 0;
     const std::string& cur_file_path = output_path + solution_name + extension;
     {
-        Timer timer("    Writing in file time: ");
-        Writer::write(solution.GetCurrentValues(), cur_file_path);
+        ThroughputTimer timer("    Writing in file time: ");
+        timer.SetBytes(Writer::write_parallel(solution.GetCurrentValues(), cur_file_path));
     }
 
     if (!compare_to_correct_solution) {
@@ -43,6 +149,32 @@ bool write_and_check(Solution& solution, const std::string& output_path, const s
     return check_correctness(correct_file_path, cur_file_path);
 }
 
+// Write the same values by std::endl based writer, by parallel writer and in the order kept by the solution.
+bool compare_writers(FastSolution& solution, const std::string& output_path) {
+    const std::string& file_path = output_path + "WriterComparison.txt";
+    const std::string& ordered_file_path = output_path + "WriterComparisonOrdered.txt";
+    OutputData output_data = solution.GetCurrentValues();
+    std::cout << std::endl << "Writers comparison:" << std::endl;
+    {
+        ThroughputTimer timer("    Writer::write time: ");
+        Writer::write(output_data, file_path);
+        timer.SetBytes(get_file_size(file_path));
+    }
+    {
+        ThroughputTimer timer("    Writer::write_parallel time: ");
+        timer.SetBytes(Writer::write_parallel(output_data, file_path));
+    }
+    {
+        ThroughputTimer timer("    Writing with sorting of the output order time: ");
+        timer.SetBytes(solution.WriteCurrentValues(ordered_file_path));
+    }
+    {
+        ThroughputTimer timer("    Writing in the kept output order time: ");
+        timer.SetBytes(solution.WriteCurrentValues(ordered_file_path));
+    }
+    return check_correctness(file_path, ordered_file_path);
+}
+
 bool test_solution(Solution& solution, const InputData& initial_data, const InputData& modifications_small_data,
                    const InputData& modifications_medium_data, const InputData& modifications_large_data,
                    const std::string& output_path, const std::string& solution_name,
@@ -103,11 +235,387 @@ bool test_solution(Solution& solution, const InputData& initial_data, const Inpu
                          modifications_large_data, output_path, solution_name, "");
 }
 
+// Solutions which don't add cells ignore edits of unknown cells and edits which reference unknown cells.
+bool test_unknown_cells(Solution& solution, const std::string& solution_name) {
+    std::string first_name = "A1";
+    std::string second_name = "A2";
+    Formula first_formula = { Addend(Addend::VALUE, 1) };
+    Formula second_formula = { Addend(Addend::CELL, 0), Addend(Addend::VALUE, 2) };
+    solution.InitialCalculate(InputData{ InputCellInfo(0, first_name, first_formula), InputCellInfo(1, second_name, second_formula) });
+    OutputData values = solution.GetCurrentValues();
+    solution.ChangeCell("B1", Formula{ Addend(Addend::VALUE, 3) });
+    solution.ChangeCell("A2", Formula{ Addend(Addend::CELL, 2) });
+    solution.ChangeCell("A2", Formula{ Addend(Addend::CELL, -1) });
+    if (solution.GetCurrentValues() != values) {
+        std::cout << "    FAIL!!! " << solution_name << " changed cells by an edit of an unknown cell" << std::endl;
+        return false;
+    }
+    std::cout << "    " << solution_name << " ignores edits of unknown cells, ok" << std::endl;
+    return true;
+}
+
+// Sheet which is generated, so solutions are compared on thousands of cells whatever the input files are.
+struct GeneratedSheet {
+    InputData initial_data;
+    InputData modifications_small_data;
+    InputData modifications_medium_data;
+    InputData modifications_large_data;
+};
+
+// Columns of 'rows' cells, ids go column by column. A cell references the cell above it, cells of the previous
+// column near its row and rarely a cell of any earlier column, so most of edges are inside a tile or between
+// neighbour tiles, and chains in a column are at most 8 cells long, so the depth of the graph is at most
+// 8 * columns. Edits give new formulas of the same kind, values, or restore the formula of the initial sheet.
+GeneratedSheet generate_sheet(int columns, int rows, unsigned seed) {
+    std::mt19937 random(seed);
+    auto formula_of = [&](int cell) {
+        int column = cell / rows;
+        int row = cell % rows;
+        Formula formula;
+        if (row % 8 != 0 && random() % 2 == 0) {
+            formula.push_back(Addend(Addend::CELL, cell - 1));
+        }
+        if (column > 0) {
+            int references_count = 1 + random() % 2;
+            for (int i = 0; i < references_count; i++) {
+                int near_row = std::clamp(row + (int) (random() % 33) - 16, 0, rows - 1);
+                formula.push_back(Addend(Addend::CELL, (column - 1) * rows + near_row));
+            }
+        }
+        if (column > 1 && random() % 8 == 0) {
+            formula.push_back(Addend(Addend::CELL, random() % ((column - 1) * rows)));
+        }
+        formula.push_back(Addend(Addend::VALUE, (int) (random() % 201) - 100));
+        return formula;
+    };
+
+    GeneratedSheet sheet;
+    int cells_count = columns * rows;
+    for (int cell = 0; cell < cells_count; cell++) {
+        std::string name = std::string(1, char('A' + cell / rows)) + std::to_string(cell % rows + 1);
+        Formula formula = formula_of(cell);
+        sheet.initial_data.push_back(InputCellInfo(cell, name, formula));
+    }
+    auto generate_edits = [&](InputData& edits, int edits_count) {
+        for (int i = 0; i < edits_count; i++) {
+            int cell = random() % cells_count;
+            std::string name = sheet.initial_data[cell].name;
+            int kind = random() % 4;
+            Formula formula = kind == 0 ? Formula{ Addend(Addend::VALUE, (int) (random() % 201) - 100) }
+                                        : (kind == 1 ? sheet.initial_data[cell].formula : formula_of(cell));
+            edits.push_back(InputCellInfo(cell, name, formula));
+        }
+    };
+    generate_edits(sheet.modifications_small_data, 10);
+    generate_edits(sheet.modifications_medium_data, 200);
+    generate_edits(sheet.modifications_large_data, 2000);
+    return sheet;
+}
+
+// Cells are added and deleted while other threads read values. Added cells reference loaded cells and
+// the previous added cell, the oldest one is deleted, so its dependent gets a reference error. The result
+// is compared to the workbook which is loaded with the remaining cells at once.
+bool test_add_delete(const InputData& initial_data, const InputData& modifications_medium_data, const std::string& output_path,
+                     const std::string& sheet_name) {
+    std::cout << std::endl << sheet_name << "FastSolution insertion and deletion of cells:" << std::endl;
+    FastSolution solution;
+    solution.InitialCalculate(initial_data);
+    int loaded_count = initial_data.size();
+
+    const int window = 100;
+    const int rounds = 20000;
+    std::vector<std::string> names;
+    for (int row = 1; (int) names.size() < rounds; row++) {
+        std::string name = "Y" + std::to_string(row);
+        if (solution.FindCell(name) == -1) {
+            names.push_back(name);
+        }
+    }
+    // Formulas of added cells by their numbers, cell references of added cells are negative: -1 - number.
+    std::vector<Formula> formulas(rounds);
+    std::mt19937 random(23);
+    std::atomic<bool> stopped{false};
+    std::atomic<int> added_count{0};
+    std::atomic<uint64_t> reads_count{0};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 2; i++) {
+        readers.emplace_back([&, i]() {
+            std::mt19937 reader_random(i);
+            ValueType value;
+            while (!stopped) {
+                int added = added_count.load();
+                const std::string& name = added > 0 && reader_random() % 2 ? names[reader_random() % added]
+                                                                           : initial_data[reader_random() % loaded_count].name;
+                reads_count += solution.ReadValue(name, value);
+            }
+        });
+    }
+    std::size_t ids_count_before = solution.GetIdsCount();
+    // The output order is kept, so deleted cells are removed from it and cells which reuse their ids are inserted.
+    solution.GetOutputOrder();
+    {
+        AllocationCounter counter("    " + std::to_string(rounds) + " rounds of AddCell() and DeleteCell(): ");
+        Timer timer("    AddCell() and DeleteCell() 1 round in average: ", rounds);
+        for (int i = 0; i < rounds; i++) {
+            Formula formula = { Addend(Addend::CELL, random() % loaded_count), Addend(Addend::VALUE, i % 100) };
+            if (i > 0) {
+                formula.push_back(Addend(Addend::CELL, solution.FindCell(names[i - 1])));
+                formulas[i] = { formula[0], formula[1], Addend(Addend::CELL, -i) };
+            } else {
+                formulas[i] = formula;
+            }
+            solution.AddCell(names[i], formula);
+            added_count = i + 1;
+            if (i >= window) {
+                solution.DeleteCell(names[i - window]);
+                int dependent = i - window + 1;
+                formulas[dependent].back() = Addend(Addend::VALUE, kReferenceError);
+            }
+        }
+    }
+    stopped = true;
+    for (auto& it : readers) {
+        it.join();
+    }
+    std::cout << "    ids: " << ids_count_before << " before, " << solution.GetIdsCount() << " after, "
+              << solution.GetRetiredCellsCount() << " deleted cells are not freed, " << reads_count.load()
+              << " concurrent reads" << std::endl;
+
+    InputData all_data = initial_data;
+    for (int i = rounds - window; i < rounds; i++) {
+        Formula formula = formulas[i];
+        for (auto& it : formula) {
+            if (it.type == Addend::CELL && it.value < 0) {
+                it.value = loaded_count + (-1 - it.value) - (rounds - window);
+            }
+        }
+        all_data.push_back(InputCellInfo(loaded_count + i - (rounds - window), names[i], formula));
+    }
+    FastSolution reloaded;
+    reloaded.InitialCalculate(all_data);
+    if (solution.GetCurrentValues() != reloaded.GetCurrentValues() || solution.GetIdsCount() > ids_count_before + window + 1) {
+        std::cout << "    FAIL!!! added and deleted cells have wrong values" << std::endl;
+        return false;
+    }
+    solution.WriteCurrentValues(output_path + sheet_name + "FastSolutionChurn.ordered.txt");
+    reloaded.WriteCurrentValues(output_path + sheet_name + "FastSolutionReloaded.ordered.txt");
+    if (!check_correctness(output_path + sheet_name + "FastSolutionReloaded.ordered.txt", output_path + sheet_name + "FastSolutionChurn.ordered.txt")) {
+        std::cout << "    FAIL!!! output order after additions and deletions" << std::endl;
+        return false;
+    }
+
+    // A deleted precedent of many cells: its dependents are errors, a snapshot keeps the deleted id.
+    const std::string& precedent = modifications_medium_data.front().name;
+    int precedent_id = solution.FindCell(precedent);
+    solution.DeleteCell(precedent);
+    OutputData values = solution.GetCurrentValues();
+    std::size_t errors_count = std::count_if(values.begin(), values.end(),
+        [](const auto& it) { return it.second == kReferenceError; });
+    std::string snapshot_path = output_path + sheet_name + "fast_add_delete.snapshot";
+    std::string error;
+    FastSolution restored;
+    if (errors_count == 0 || !solution.SaveSnapshot(snapshot_path) || !restored.LoadSnapshot(snapshot_path, error) ||
+        restored.GetCurrentValues() != values) {
+        std::cout << "    FAIL!!! deleted cell " << precedent << " " << error << std::endl;
+        return false;
+    }
+    std::cout << "    " << errors_count << " reference errors after deletion of " << precedent << ", snapshot ok" << std::endl;
+
+    // Ids of deleted and unknown cells are rejected by the hot path of ChangeCell().
+    if (solution.ChangeCell(precedent_id, Formula{ Addend(Addend::VALUE, 1) }) || solution.ChangeCell(-1, Formula()) ||
+        solution.ChangeCell((int) solution.GetValues().size(), Formula()) || solution.GetCurrentValues() != values) {
+        std::cout << "    FAIL!!! ChangeCell() of a deleted or unknown id" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// All medium edits are undone and redone by the journal, values are compared to the states before and after them.
+bool test_journal(const InputData& initial_data, const InputData& modifications_medium_data, const std::string& sheet_name) {
+    std::cout << std::endl << sheet_name << "FastSolution undo/redo journal:" << std::endl;
+    FastSolution solution;
+    solution.InitialCalculate(initial_data);
+    OutputData initial_values = solution.GetCurrentValues();
+    solution.EnableJournal(std::size_t(1) << 30);
+    std::size_t max_entry_bytes = 0;
+    {
+        Timer timer("    [medium] ChangeCell with journal 1 call in average: ", modifications_medium_data.size());
+        for (const auto& it : modifications_medium_data) {
+            std::size_t journal_bytes = solution.GetJournalBytes();
+            solution.ChangeCell(it.name, it.formula);
+            max_entry_bytes = std::max(max_entry_bytes, solution.GetJournalBytes() - journal_bytes);
+        }
+    }
+    OutputData changed_values = solution.GetCurrentValues();
+    std::cout << "    journal: " << solution.GetJournalBytes() / 1024 << " KB" << std::endl;
+    std::size_t undone_count = 0, redone_count = 0;
+    {
+        Timer timer("    [medium] Undo 1 call in average: ", modifications_medium_data.size());
+        while (solution.Undo()) {
+            undone_count++;
+        }
+    }
+    bool undo_ok = undone_count == modifications_medium_data.size() && solution.GetCurrentValues() == initial_values;
+    {
+        Timer timer("    [medium] Redo 1 call in average: ", modifications_medium_data.size());
+        while (solution.Redo()) {
+            redone_count++;
+        }
+    }
+    bool redo_ok = redone_count == modifications_medium_data.size() && solution.GetCurrentValues() == changed_values;
+    if (!undo_ok || !redo_ok) {
+        std::cout << "    FAIL!!! undo " << (undo_ok ? "ok" : "failed") << ", redo " << (redo_ok ? "ok" : "failed") << std::endl;
+        return false;
+    }
+
+    // Small budget: the oldest entries are evicted, but at least 3 newest ones fit into it. The edits are
+    // applied the second time, so the state after undo is the state after all edits and a prefix of them.
+    std::size_t budget = std::max<std::size_t>(64 * 1024, 3 * max_entry_bytes);
+    solution.EnableJournal(budget);
+    for (const auto& it : modifications_medium_data) {
+        solution.ChangeCell(it.name, it.formula);
+    }
+    bool budget_ok = solution.GetJournalBytes() <= budget;
+    undone_count = 0;
+    while (solution.Undo()) {
+        undone_count++;
+    }
+    FastSolution replayed;
+    replayed.InitialCalculate(initial_data);
+    for (const auto& it : modifications_medium_data) {
+        replayed.ChangeCell(it.name, it.formula);
+    }
+    for (std::size_t i = 0; i + undone_count < modifications_medium_data.size(); i++) {
+        replayed.ChangeCell(modifications_medium_data[i].name, modifications_medium_data[i].formula);
+    }
+    bool eviction_ok = budget_ok && undone_count >= std::min<std::size_t>(3, modifications_medium_data.size()) &&
+        solution.GetCurrentValues() == replayed.GetCurrentValues();
+    if (!eviction_ok) {
+        std::cout << "    FAIL!!! " << undone_count << " edits are undone with " << budget / 1024 << " KB budget, journal "
+            << (budget_ok ? "fits" : "exceeds") << " the budget" << std::endl;
+        return false;
+    }
+    std::cout << "    undo/redo ok, " << undone_count << " edits can be undone with " << budget / 1024 << " KB budget" << std::endl;
+
+    // Edits which add or append cells clear the journal, edits after them can be undone.
+    std::string added_name = "ZZ1";
+    std::string appended_name = "ZZ2";
+    Formula added_formula = { Addend(Addend::VALUE, 1) };
+    Formula appended_formula = { Addend(Addend::VALUE, 2) };
+    const auto& edit = modifications_medium_data.front();
+    solution.ChangeCell(edit.name, edit.formula);
+    solution.ChangeCell(added_name, added_formula);
+    bool added_ok = solution.GetJournalBytes() == 0 && !solution.Undo();
+    solution.ChangeCell(edit.name, edit.formula);
+    std::string error;
+    bool appended_ok = solution.AppendCells(InputData{ InputCellInfo(solution.GetValues().size(), appended_name, appended_formula) }, error) &&
+        solution.GetJournalBytes() == 0 && !solution.Undo();
+    solution.ChangeCell(edit.name, edit.formula);
+    bool undo_after_ok = solution.Undo() && !solution.Undo();
+    if (!added_ok || !appended_ok || !undo_after_ok) {
+        std::cout << "    FAIL!!! journal after added cells: added " << added_ok << ", appended " << appended_ok
+                  << ", undo of later edits " << undo_after_ok << std::endl;
+        return false;
+    }
+    std::cout << "    journal is cleared by added cells, ok" << std::endl;
+    return true;
+}
+
+// Scenarios give their own values to cells edited by medium modifications, every lane kernel is compared to the others
+// and scenarios are compared to forks.
+bool test_scenarios(const InputData& initial_data, const InputData& modifications_medium_data, const std::string& sheet_name) {
+    std::cout << std::endl << sheet_name << "ScenarioSolution, scenarios evaluated in one pass:" << std::endl;
+    FastSolution solution;
+    solution.InitialCalculate(initial_data);
+    auto base = solution.GetForkBase();
+    // Inputs are cells edited by medium modifications, a scenario gives its own values to them.
+    std::vector<int> inputs;
+    for (const auto& it : modifications_medium_data) {
+        inputs.push_back(solution.FindCell(it.name));
+    }
+    auto input_value = [](std::size_t input, int scenario) { return ValueType(input * 7 + scenario); };
+
+    const int scenarios_count = 16;
+    auto run = [&](auto lanes, SumLanesKernel kernel) {
+        constexpr int K = decltype(lanes)::value;
+        std::vector<ScenarioSolution<K>> passes;
+        for (int pass = 0; pass < scenarios_count / K; pass++) {
+            passes.emplace_back(base, kernel);
+            for (std::size_t i = 0; i < inputs.size(); i++) {
+                typename ScenarioSolution<K>::Lanes values;
+                for (int lane = 0; lane < K; lane++) {
+                    values.value[lane] = input_value(i, pass * K + lane);
+                }
+                passes.back().SetInput(inputs[i], values);
+            }
+        }
+        {
+            std::string lanes_name = K == 1 ? "1 lane" : std::to_string(K) + " lanes (" + kernel.name + ")";
+            Timer timer("    " + lanes_name + ", Recalculate of " + std::to_string(scenarios_count) + " scenarios: ");
+            for (auto& it : passes) {
+                it.Recalculate();
+            }
+        }
+        return passes;
+    };
+    // Every lane kernel which the CPU supports should give the same values as the selected one.
+    bool kernels_ok = true;
+    auto run_kernels = [&](auto lanes) {
+        constexpr int K = decltype(lanes)::value;
+        std::vector<SumLanesKernel> kernels = GetSumLanesKernels(K);
+        auto passes = run(lanes, kernels.front());
+        for (std::size_t i = 1; i < kernels.size(); i++) {
+            auto other_passes = run(lanes, kernels[i]);
+            for (std::size_t pass = 0; pass < passes.size(); pass++) {
+                for (std::size_t cell = 0; cell < base->cells_count; cell++) {
+                    for (int lane = 0; lane < K; lane++) {
+                        kernels_ok = kernels_ok && passes[pass].GetValue(cell, lane) == other_passes[pass].GetValue(cell, lane);
+                    }
+                }
+            }
+        }
+        return passes;
+    };
+    auto single_lane_passes = run(std::integral_constant<int, 1>(), GetSumLanesKernel(1));
+    run_kernels(std::integral_constant<int, 4>());
+    run_kernels(std::integral_constant<int, 8>());
+    auto passes = run_kernels(std::integral_constant<int, 16>());
+    if (!kernels_ok) {
+        std::cout << "    FAIL!!! lane kernels give different values" << std::endl;
+        return false;
+    }
+
+    // A scenario gives the same values as a fork with values of inputs.
+    bool scenarios_ok = true;
+    for (int scenario : { 0, 5, 15 }) {
+        SolutionFork fork = solution.Fork();
+        for (std::size_t i = 0; i < inputs.size(); i++) {
+            fork.ChangeCell(inputs[i], Formula{ Addend(Addend::VALUE, input_value(i, scenario)) });
+        }
+        for (std::size_t cell = 0; cell < fork.GetCellsCount(); cell++) {
+            scenarios_ok = scenarios_ok && passes[0].GetValue(cell, scenario) == fork.GetValue(cell) &&
+                single_lane_passes[scenario].GetValue(cell, 0) == fork.GetValue(cell);
+        }
+    }
+    if (!scenarios_ok) {
+        std::cout << "    FAIL!!! values of scenarios differ from values of forks" << std::endl;
+        return false;
+    }
+    std::cout << "    scenarios ok" << std::endl;
+    return true;
+}
+
+const std::size_t memo_cache_capacity = 1 << 20;
+
+inline void print_memo_cache_stats(MemoCache& memo_cache) {
+    std::cout << "    Memo cache: " << memo_cache.GetHitsCount() << " hits, " << memo_cache.GetMissesCount() << " misses, "
+              << memo_cache.GetSize() << " entries, " << memo_cache.GetMemoryUsage() / 1024 << " KB" << std::endl;
+}
+
 // Check if file can be opened.
-inline bool validate_file(std::ifstream& s, const std::string& file_name) {
-    if (!s.is_open()) {
+inline bool validate_file(const std::string& file_name) {
+    if (!MappedFile(file_name).IsOpen()) {
         std::cout << "Unable to open file " << file_name << std::endl;
-        s.close();
         return false;
     }
     return true;
@@ -119,56 +627,55 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    std::ifstream initial_file(argv[1]);
-    if (!validate_file(initial_file, argv[1])) {
+    if (!validate_file(argv[1])) {
         return 1;
     }
 
-    std::ifstream modifications_small_file(argv[2]);
-    if (!validate_file(modifications_small_file, argv[2])) {
+    if (!validate_file(argv[2])) {
         return 1;
     }
 
-    std::ifstream modifications_medium_file(argv[3]);
-    if (!validate_file(modifications_medium_file, argv[3])) {
+    if (!validate_file(argv[3])) {
         return 1;
     }
 
-    std::ifstream modifications_large_file(argv[4]);
-    if (!validate_file(modifications_large_file, argv[4])) {
+    if (!validate_file(argv[4])) {
         return 1;
     }
 
 
-    std::unordered_map<std::string, int> ids;
+    CellIds ids;
     std::cout << "Threads count = " << get_threads_count() << std::endl;
     InputData initial_data;
     {
-        Timer timer("Reading initial file time: ");
-        initial_data = Reader::Read(initial_file, ids);
-        std::sort(initial_data.begin(), initial_data.end(), [](InputCellInfo& a, InputCellInfo& b) { return a.id < b.id; });
-        initial_file.close();
+        ThroughputTimer timer("Reading initial file time: ", get_file_size(argv[1]));
+        // Cells get ids by line numbers, so initial_data is already sorted by id.
+        initial_data = Reader::ReadInitialParallel(argv[1], ids);
+    }
+
+    {
+        // Sequential reader of the mapped file, for comparison only.
+        CellIds mapped_ids;
+        ThroughputTimer timer("Reading initial file by the sequential mapped reader time: ", get_file_size(argv[1]));
+        Reader::ReadMapped(argv[1], mapped_ids);
     }
 
     InputData modifications_small_data;
     {
         Timer timer("Reading small modifications file time: ");
-        modifications_small_data = Reader::Read(modifications_small_file, ids);
-        modifications_small_file.close();
+        modifications_small_data = Reader::ReadMapped(argv[2], ids);
     }
 
     InputData modifications_medium_data;
     {
         Timer timer("Reading medium modifications file time: ");
-        modifications_medium_data = Reader::Read(modifications_medium_file, ids);
-        modifications_medium_file.close();
+        modifications_medium_data = Reader::ReadMapped(argv[3], ids);
     }
 
     InputData modifications_large_data;
     {
         Timer timer("Reading large modifications file time: ");
-        modifications_large_data = Reader::Read(modifications_large_file, ids);
-        modifications_large_file.close();
+        modifications_large_data = Reader::ReadMapped(argv[4], ids);
     }
 
     std::string output_path = std::string(argv[5]);
@@ -176,6 +683,9 @@ int main(int argc, char** argv) {
         output_path += '/';
     }
 
+    // Sheet with 16K cells in 16 columns of 1024 rows, 4 tiles of TiledSolution in a column.
+    GeneratedSheet generated = generate_sheet(16, 1024, 7);
+
     // Run simple one thread solution.
     const std::string& correct_solution = ""; // "OneThreadSimple";
     
@@ -191,14 +701,824 @@ int main(int argc, char** argv) {
 
     {
         // Test fast solution, compare results to OneThreadSimple solution's output.
-        Solution* solution = new FastSolution();
+        FastSolution* solution = new FastSolution();
+        if (milliseconds > 0) {
+            // Sums are expensive, so cells which see the same values as before are taken from the cache.
+            solution->EnableMemoization(memo_cache_capacity);
+        }
         bool success = test_solution(*solution, initial_data, modifications_small_data, modifications_medium_data, modifications_large_data,
             output_path, "FastSolution", correct_solution);
+        if (solution->GetMemoCache()) {
+            print_memo_cache_stats(*solution->GetMemoCache());
+        }
+        success = compare_writers(*solution, output_path) && success;
+        delete solution;
+        if (!success) {
+            return 1;
+        }
+    }
+
+    {
+        // The generated sheet: results of FastSolution are compared to OneThreadSimple solution's output,
+        // other solutions are compared to FastSolution's output.
+        Solution* simple = new OneThreadSimpleSolution();
+        bool success = test_solution(*simple, generated.initial_data, generated.modifications_small_data, generated.modifications_medium_data,
+            generated.modifications_large_data, output_path, "GeneratedOneThreadSimple");
+        delete simple;
+        Solution* solution = new FastSolution();
+        success = success && test_solution(*solution, generated.initial_data, generated.modifications_small_data, generated.modifications_medium_data,
+            generated.modifications_large_data, output_path, "GeneratedFastSolution", "GeneratedOneThreadSimple");
+        delete solution;
+        if (!success) {
+            return 1;
+        }
+    }
+
+    {
+        // Fast solution with memoization, compare results to FastSolution's output.
+        FastSolution* solution = new FastSolution();
+        solution->EnableMemoization(memo_cache_capacity);
+        bool success = test_solution(*solution, initial_data, modifications_small_data, modifications_medium_data, modifications_large_data,
+            output_path, "FastSolutionMemoized", "FastSolution");
+        print_memo_cache_stats(*solution->GetMemoCache());
+
+        // Formulas are switched between values and back, so cached results of dependents are found again
+        // and have to be rejected when values of their cells are different.
+        FastSolution plain;
+        plain.InitialCalculate(initial_data);
+        solution->InitialCalculate(initial_data);
+        std::size_t edits_count = std::min<std::size_t>(modifications_medium_data.size(), 20);
+        for (std::size_t i = 0; i < edits_count && success; i++) {
+            const auto& edit = modifications_medium_data[i];
+            for (const Formula& formula : { Formula{ Addend(Addend::VALUE, 1) }, edit.formula,
+                                            Formula{ Addend(Addend::VALUE, 2) }, edit.formula }) {
+                plain.ChangeCell(edit.name, formula);
+                solution->ChangeCell(edit.name, formula);
+            }
+            success = solution->GetCurrentValues() == plain.GetCurrentValues();
+        }
+        print_memo_cache_stats(*solution->GetMemoCache());
+        delete solution;
+        if (!success) {
+            std::cout << "    FAIL!!! memoized values differ from values of FastSolution" << std::endl;
+            return 1;
+        }
+        std::cout << "    memoization ok" << std::endl;
+    }
+
+    {
+        // A quarter of generated edits restores the initial formula of a cell, so its dependents see the values
+        // which they saw before and are taken from the cache.
+        FastSolution* solution = new FastSolution();
+        solution->EnableMemoization(memo_cache_capacity);
+        bool success = test_solution(*solution, generated.initial_data, generated.modifications_small_data, generated.modifications_medium_data,
+            generated.modifications_large_data, output_path, "GeneratedFastSolutionMemoized", "GeneratedFastSolution");
+        print_memo_cache_stats(*solution->GetMemoCache());
+        bool hits_ok = solution->GetMemoCache()->GetHitsCount() > 0;
+        delete solution;
+        if (!success) {
+            return 1;
+        }
+        if (!hits_ok) {
+            std::cout << "    FAIL!!! no cached values are used for the generated sheet" << std::endl;
+            return 1;
+        }
+    }
+
+    {
+        // Streaming load of fast solution: cells are evaluated while the initial file is being parsed,
+        // compare results to FastSolution's output.
+        FastSolution* solution = new FastSolution();
+        CellIds stream_ids;
+        std::cout << std::endl << "FastSolution streaming load:" << std::endl;
+        {
+            ThroughputTimer timer("    Reading and InitialCalculate overall time: ", get_file_size(argv[1]));
+            Reader::ReadStreaming(argv[1], stream_ids, [&](int cells_count) { solution->BeginLoad(cells_count); },
+                                  [&](InputCellInfo& cell) { solution->LoadCell(cell); });
+            solution->EndLoad();
+        }
+        {
+            // The second load replaces cells of the first one, they are freed by BeginLoad().
+            ThroughputTimer timer("    Reading and InitialCalculate again time: ", get_file_size(argv[1]));
+            CellIds reload_ids;
+            Reader::ReadStreaming(argv[1], reload_ids, [&](int cells_count) { solution->BeginLoad(cells_count); },
+                                  [&](InputCellInfo& cell) { solution->LoadCell(cell); });
+            solution->EndLoad();
+        }
+        bool success = write_and_check(*solution, output_path, "FastSolutionStreaming", "FastSolution", ".initial.txt");
+        delete solution;
+        if (!success) {
+            return 1;
+        }
+    }
+
+    {
+        // Snapshot of the initial state. Startup from the snapshot is measured as time until the first ChangeCell
+        // is served, compare results after small modifications to FastSolution's output.
+        const std::string& snapshot_path = output_path + "FastSolution.snapshot";
+        std::cout << std::endl << "FastSolution snapshot:" << std::endl;
+        {
+            FastSolution solution;
+            solution.InitialCalculate(initial_data);
+            Timer timer("    SaveSnapshot time: ");
+            if (!solution.SaveSnapshot(snapshot_path)) {
+                std::cout << "Cannot write the snapshot " << snapshot_path << std::endl;
+                return 1;
+            }
+        }
+
+        FastSolution* solution = new FastSolution();
+        std::string error;
+        {
+            Timer timer("    Startup from snapshot time (LoadSnapshot and the first ChangeCell): ");
+            if (!solution->LoadSnapshot(snapshot_path, error)) {
+                std::cout << "Cannot load the snapshot " << snapshot_path << ": " << error << std::endl;
+                return 1;
+            }
+            if (!modifications_small_data.empty()) {
+                solution->ChangeCell(modifications_small_data[0].name, modifications_small_data[0].formula);
+            }
+        }
+        for (std::size_t i = 1; i < modifications_small_data.size(); i++) {
+            solution->ChangeCell(modifications_small_data[i].name, modifications_small_data[i].formula);
+        }
+        bool success = write_and_check(*solution, output_path, "FastSolutionSnapshot", "FastSolution", ".modifications_small.txt");
+        delete solution;
+        if (!success) {
+            return 1;
+        }
+    }
+
+    {
+        // Durable edits: every edit is appended to the edit log before ChangeCell, edits share fsync by group commit.
+        // A checkpoint is taken after small modifications. Then the process "crashes" after medium modifications
+        // and a few deletions and additions of cells, the state is recovered from the checkpoint and the log tail.
+        // Results are compared to the output of the logged solution.
+        const std::string& log_path = output_path + "FastSolution.log";
+        const std::string& checkpoint_path = output_path + "FastSolution.checkpoint";
+        std::remove(log_path.c_str());
+        std::remove(checkpoint_path.c_str());
+        std::cout << std::endl << "FastSolution with edit log:" << std::endl;
+        {
+            FastSolution solution;
+            solution.InitialCalculate(initial_data);
+            EditLog log(log_path);
+            auto save = [&](const std::string& path) { return solution.SaveSnapshot(path); };
+            bool success = log.IsOpen() && log.Checkpoint(checkpoint_path, save);
+
+            auto apply = [&](const InputData& modifications) {
+                uint64_t sequence = 0;
+                for (const auto& it : modifications) {
+                    sequence = log.Append(it.name, it.formula);
+                    solution.ChangeCell(it.name, it.formula);
+                }
+                return log.WaitDurable(sequence);
+            };
+            {
+                Timer timer("    [small] ChangeCell with edit log 1 call in average: ", modifications_small_data.size());
+                success = success && apply(modifications_small_data);
+            }
+            {
+                Timer timer("    Checkpoint time: ");
+                success = success && log.Checkpoint(checkpoint_path, save);
+            }
+            {
+                Timer timer("    [medium] ChangeCell with edit log 1 call in average: ", modifications_medium_data.size());
+                success = success && apply(modifications_medium_data);
+            }
+            if (!success || !write_and_check(solution, output_path, "FastSolutionLogged", "FastSolution", ".modifications_medium.txt")) {
+                std::cout << "Cannot write the edit log " << log_path << std::endl;
+                return 1;
+            }
+
+            // Deletions and additions are logged too. Added cells take ids of deleted ones and refer to each other
+            // by ids, so replay should give the same ids.
+            uint64_t sequence = 0;
+            std::size_t count = std::min<std::size_t>(3, initial_data.size() / 2);
+            for (std::size_t i = 0; i < count; i++) {
+                sequence = log.AppendDeletion(initial_data[2 * i].name);
+                solution.DeleteCell(initial_data[2 * i].name);
+            }
+            Formula formula = { Addend(Addend::VALUE, 1) };
+            for (std::size_t i = 0; i < count; i++) {
+                std::string name = "Y" + std::to_string(i + 1);
+                while (solution.FindCell(name) != -1) {
+                    name += "0";
+                }
+                sequence = log.Append(name, formula);
+                solution.AddCell(name, formula);
+                formula.push_back(Addend(Addend::CELL, solution.FindCell(name)));
+            }
+            if (!log.WaitDurable(sequence) ||
+                !write_and_check(solution, output_path, "FastSolutionLogged", "", ".structural.txt")) {
+                std::cout << "Cannot write the edit log " << log_path << std::endl;
+                return 1;
+            }
+        }
+
+        FastSolution* solution = new FastSolution();
+        std::string error;
+        {
+            Timer timer("    Recovery time (checkpoint and log replay): ");
+            if (!solution->LoadSnapshot(checkpoint_path, error)) {
+                std::cout << "Cannot load the checkpoint " << checkpoint_path << ": " << error << std::endl;
+                return 1;
+            }
+            EditLog::ReadEdits(log_path, [&](const InputData& edits) { solution->ChangeCells(edits); },
+                               [&](const std::string& cell) { solution->DeleteCell(cell); });
+        }
+        bool success = write_and_check(*solution, output_path, "FastSolutionRecovered", "FastSolutionLogged", ".structural.txt");
+        delete solution;
+        if (!success) {
+            return 1;
+        }
+    }
+
+    {
+        // Background snapshot of the initial state while medium modifications are applied. Edit latency is compared
+        // to the same edits without snapshot, the snapshot should contain the initial state.
+        const std::string& snapshot_path = output_path + "FastSolution.background.snapshot";
+        std::cout << std::endl << "FastSolution background snapshot:" << std::endl;
+        {
+            FastSolution solution;
+            solution.InitialCalculate(initial_data);
+            Timer timer("    [medium] ChangeCell without snapshot 1 call in average: ", modifications_medium_data.size());
+            for (const auto& it : modifications_medium_data) {
+                solution.ChangeCell(it.name, it.formula);
+            }
+        }
+        {
+            FastSolution solution;
+            solution.InitialCalculate(initial_data);
+            bool success;
+            {
+                Timer timer("    StartBackgroundSnapshot time: ");
+                success = solution.StartBackgroundSnapshot(snapshot_path);
+            }
+            {
+                Timer timer("    [medium] ChangeCell during snapshot 1 call in average: ", modifications_medium_data.size());
+                for (const auto& it : modifications_medium_data) {
+                    solution.ChangeCell(it.name, it.formula);
+                }
+            }
+            {
+                Timer timer("    Waiting for snapshot time: ");
+                success = success && solution.WaitBackgroundSnapshot();
+            }
+            if (!success) {
+                std::cout << "Cannot write the snapshot " << snapshot_path << std::endl;
+                return 1;
+            }
+        }
+
+        FastSolution* solution = new FastSolution();
+        std::string error;
+        if (!solution->LoadSnapshot(snapshot_path, error)) {
+            std::cout << "Cannot load the snapshot " << snapshot_path << ": " << error << std::endl;
+            return 1;
+        }
+        bool success = write_and_check(*solution, output_path, "FastSolutionBackgroundSnapshot", "FastSolution", ".initial.txt");
+        delete solution;
+        if (!success) {
+            return 1;
+        }
+    }
+
+    {
+        // Output file is patched by every edit of small and medium modifications. It is read back as a consumer
+        // would read it and should contain the same values as FastSolution's output after medium modifications.
+        const std::string& patched_path = output_path + "FastSolution.patched.txt";
+        std::cout << std::endl << "FastSolution patched output:" << std::endl;
+        FastSolution solution;
+        solution.InitialCalculate(initial_data);
+        {
+            Timer timer("    EnablePatchedOutput time: ");
+            if (!solution.EnablePatchedOutput(patched_path)) {
+                return 1;
+            }
+        }
+        {
+            Timer timer("    [small] ChangeCell with patched output 1 call in average: ", modifications_small_data.size());
+            for (const auto& it : modifications_small_data) {
+                solution.ChangeCell(it.name, it.formula);
+            }
+        }
+        {
+            Timer timer("    [medium] ChangeCell with patched output 1 call in average: ", modifications_medium_data.size());
+            for (const auto& it : modifications_medium_data) {
+                solution.ChangeCell(it.name, it.formula);
+            }
+        }
+
+        std::vector<std::pair<std::string, ValueType>> records;
+        uint64_t version;
+        auto read_records = [&](const std::string& records_path) {
+            if (!PatchedOutputFile::Read(patched_path, records, version)) {
+                std::cout << "Cannot read the patched output " << patched_path << std::endl;
+                return false;
+            }
+            std::ofstream records_file(records_path);
+            for (const auto& it : records) {
+                records_file << it.first << " = ";
+                if (it.second == kReferenceError) {
+                    records_file << "#REF!\n";
+                } else {
+                    records_file << it.second << "\n";
+                }
+            }
+            return true;
+        };
+        const std::string& records_path = output_path + "FastSolutionPatched.modifications_medium.txt";
+        if (!read_records(records_path)) {
+            return 1;
+        }
+        std::cout << "    Patched output version: " << version << std::endl;
+        if (!check_correctness(output_path + "FastSolution.modifications_medium.txt", records_path)) {
+            return 1;
+        }
+
+        // A deleted cell's record is removed and the cell which reuses its id is inserted in place, without
+        // writing the file again. Both states are compared to the solution's output.
+        const std::string& deleted = modifications_medium_data.front().name;
+        solution.DeleteCell(deleted);
+        const std::string& deleted_records_path = output_path + "FastSolutionPatched.deleted.txt";
+        if (!read_records(deleted_records_path) ||
+            !write_and_check(solution, output_path, "FastSolutionDeleted", "", ".txt") ||
+            !check_correctness(output_path + "FastSolutionDeleted.txt", deleted_records_path)) {
+            return 1;
+        }
+        solution.AddCell(deleted, Formula{ Addend(Addend::VALUE, 1) });
+        const std::string& added_records_path = output_path + "FastSolutionPatched.added.txt";
+        if (!read_records(added_records_path) ||
+            !write_and_check(solution, output_path, "FastSolutionAdded", "", ".txt") ||
+            !check_correctness(output_path + "FastSolutionAdded.txt", added_records_path)) {
+            return 1;
+        }
+        std::cout << "    Deletion and addition of " << deleted << " are patched, version " << version << std::endl;
+
+        // A writer which stopped in the middle of an update leaves an odd version: readers give up after the timeout.
+        PatchedOutputFile stalled;
+        const std::string& stalled_path = output_path + "FastSolution.stalled.txt";
+        if (!stalled.Create(stalled_path, 1, 2)) {
+            return 1;
+        }
+        stalled.SetRecord(0, "A1", 1);
+        stalled.BeginUpdate();
+        bool stalled_read = PatchedOutputFile::Read(stalled_path, records, version, std::chrono::milliseconds(10));
+        stalled.EndUpdate();
+        if (stalled_read || !PatchedOutputFile::Read(stalled_path, records, version) || records.size() != 1 || records[0].second != 1) {
+            std::cout << "    FAIL!!! reader of a stalled update" << std::endl;
+            return 1;
+        }
+        std::cout << "    Reader of a stalled update gives up, ok" << std::endl;
+    }
+
+    {
+        // Output file and snapshot of the state after medium modifications are written while large modifications
+        // are applied. Blocking writes are compared to asynchronous ones, both files should contain the state after
+        // medium modifications.
+        const std::string& values_path = output_path + "FastSolutionAsync.modifications_medium.txt";
+        const std::string& snapshot_path = output_path + "FastSolution.async.snapshot";
+        std::cout << std::endl << "FastSolution asynchronous I/O (" << (AsyncFileIO().UsesIoUring() ? "io_uring" : "thread pool") << "):" << std::endl;
+        {
+            FastSolution solution;
+            solution.InitialCalculate(initial_data);
+            solution.ChangeCells(modifications_small_data);
+            solution.ChangeCells(modifications_medium_data);
+            Timer timer("    Blocking writes and [large] ChangeCell time: ");
+            solution.WriteCurrentValues(values_path);
+            solution.SaveSnapshot(snapshot_path);
+            for (const auto& it : modifications_large_data) {
+                solution.ChangeCell(it.name, it.formula);
+            }
+        }
+
+        FastSolution solution;
+        solution.InitialCalculate(initial_data);
+        solution.ChangeCells(modifications_small_data);
+        solution.ChangeCells(modifications_medium_data);
+        bool success;
+        {
+            Timer timer("    Asynchronous writes and [large] ChangeCell time: ");
+            solution.WriteCurrentValuesAsync(values_path);
+            solution.SaveSnapshotAsync(snapshot_path);
+            for (const auto& it : modifications_large_data) {
+                solution.ChangeCell(it.name, it.formula);
+            }
+            success = solution.WaitAsyncWrites();
+        }
+        if (!success) {
+            std::cout << "Cannot write files asynchronously" << std::endl;
+            return 1;
+        }
+        if (!check_correctness(output_path + "FastSolution.modifications_medium.txt", values_path)) {
+            return 1;
+        }
+        std::string error;
+        if (!solution.LoadSnapshot(snapshot_path, error)) {
+            std::cout << "Cannot load the snapshot " << snapshot_path << ": " << error << std::endl;
+            return 1;
+        }
+        if (!write_and_check(solution, output_path, "FastSolutionAsyncSnapshot", "FastSolution", ".modifications_medium.txt")) {
+            return 1;
+        }
+    }
+
+    {
+        // Columnar export of the state after medium modifications: views of values are compared to GetCurrentValues(),
+        // exported files are read back and compared to the solution.
+        const std::string& dictionary_path = output_path + "FastSolution.columnar";
+        const std::string& values_path = output_path + "FastSolution.values.columnar";
+        std::cout << std::endl << "FastSolution columnar export:" << std::endl;
+        FastSolution solution;
+        solution.InitialCalculate(initial_data);
+        solution.GetValues();
+        solution.ChangeCells(modifications_small_data);
+        solution.ChangeCells(modifications_medium_data);
+
+        OutputData output_data;
+        {
+            Timer timer("    GetCurrentValues time: ");
+            output_data = solution.GetCurrentValues();
+        }
+        Span<ValueType> values;
+        {
+            Timer timer("    GetValues time: ");
+            values = solution.GetValues();
+        }
+        bool success;
+        {
+            ThroughputTimer timer("    Export with dictionary time: ");
+            success = solution.ExportValues(dictionary_path, true, true);
+            timer.SetBytes(get_file_size(dictionary_path));
+        }
+        {
+            ThroughputTimer timer("    Export of values time: ");
+            success = solution.ExportValues(values_path, false, true) && success;
+            timer.SetBytes(get_file_size(values_path));
+        }
+
+        ColumnarReader dictionary(dictionary_path);
+        ColumnarReader exported(values_path);
+        success = success && dictionary.IsValid() && exported.IsValid() && !exported.HasNames() &&
+            exported.GetValues().size() == output_data.size() && exported.GetChangedCells().size() == solution.GetLastChangedCells().size();
+        for (std::size_t cell = 0; success && cell < values.size(); cell++) {
+            auto it = output_data.find(std::string(dictionary.GetName(cell)));
+            success = it != output_data.end() && it->second == values[cell] && exported.GetValues()[cell] == values[cell];
+        }
+        if (!success) {
+            std::cout << "Columnar export is wrong" << std::endl;
+            return 1;
+        }
+    }
+
+    {
+        // Ingestion by copying and by moving of the input. The copy of the input for moving is made before counting.
+        std::cout << std::endl << "FastSolution ingestion:" << std::endl;
+        {
+            FastSolution solution;
+            {
+                AllocationCounter counter("    InitialCalculate(const InputData&): ");
+                Timer timer("    InitialCalculate(const InputData&) time: ");
+                solution.InitialCalculate(initial_data);
+            }
+            AllocationCounter counter("    [medium] ChangeCell by name: ");
+            Timer timer("    [medium] ChangeCell by name 1 call in average: ", modifications_medium_data.size());
+            for (const auto& it : modifications_medium_data) {
+                solution.ChangeCell(it.name, it.formula);
+            }
+        }
+        {
+            FastSolution solution;
+            InputData input_data = initial_data;
+            {
+                AllocationCounter counter("    InitialCalculate(InputData&&): ");
+                Timer timer("    InitialCalculate(InputData&&) time: ");
+                solution.InitialCalculate(std::move(input_data));
+            }
+            std::vector<std::pair<int, Formula>> edits;
+            for (const auto& it : modifications_medium_data) {
+                edits.emplace_back(solution.FindCell(it.name), it.formula);
+            }
+            AllocationCounter counter("    [medium] ChangeCell by id: ");
+            Timer timer("    [medium] ChangeCell by id 1 call in average: ", edits.size());
+            for (auto& it : edits) {
+                solution.ChangeCell(it.first, std::move(it.second));
+            }
+        }
+    }
+
+    {
+        // New rows are appended to the loaded workbook and compared to the workbook which is loaded with them at once.
+        // Rows of column Z reference loaded cells and rows appended before them.
+        std::cout << std::endl << "FastSolution append of cells:" << std::endl;
+        int loaded_count = initial_data.size();
+        int appended_count = std::max(1, loaded_count / 10);
+        InputData appended_data;
+        std::mt19937 random(17);
+        for (int row = 1; (int) appended_data.size() < appended_count; row++) {
+            std::string name = "Z" + std::to_string(row);
+            if (ids.Find(name) != -1) {
+                continue;
+            }
+            int id = loaded_count + appended_data.size();
+            Formula formula;
+            for (int i = random() % 3; i >= 0; i--) {
+                int cell = id > loaded_count && random() % 2 ? loaded_count + random() % (id - loaded_count) : random() % loaded_count;
+                formula.push_back(Addend(Addend::CELL, cell));
+            }
+            formula.push_back(Addend(Addend::VALUE, random() % 100));
+            appended_data.push_back(InputCellInfo(id, name, formula));
+        }
+
+        FastSolution solution;
+        solution.InitialCalculate(initial_data);
+        std::string error;
+        bool ok;
+        {
+            Timer timer("    AppendCells() of " + std::to_string(appended_count) + " cells time: ");
+            ok = solution.AppendCells(appended_data, error);
+        }
+        InputData all_data = initial_data;
+        all_data.insert(all_data.end(), appended_data.begin(), appended_data.end());
+        FastSolution reloaded;
+        {
+            Timer timer("    InitialCalculate() of all cells time: ");
+            reloaded.InitialCalculate(all_data);
+        }
+        for (const auto& it : modifications_medium_data) {
+            solution.ChangeCell(it.name, it.formula);
+            reloaded.ChangeCell(it.name, it.formula);
+        }
+        if (!ok) {
+            std::cout << "    AppendCells() failed: " << error << std::endl;
+        }
+        if (!ok || solution.GetCurrentValues() != reloaded.GetCurrentValues()) {
+            std::cout << "    FAIL!!! appended cells have wrong values" << std::endl;
+            return 1;
+        }
+        std::cout << "    appended cells ok" << std::endl;
+        if (solution.AppendCells(appended_data, error)) {
+            std::cout << "    FAIL!!! cells were appended twice" << std::endl;
+            return 1;
+        }
+        // A name which is repeated in the batch is rejected before the solution is changed.
+        int next_id = loaded_count + appended_count;
+        std::string repeated_name = "ZZ1";
+        Formula first_formula = { Addend(Addend::VALUE, 1) };
+        Formula second_formula = { Addend(Addend::VALUE, 2) };
+        InputData repeated = { InputCellInfo(next_id, repeated_name, first_formula),
+                               InputCellInfo(next_id + 1, repeated_name, second_formula) };
+        OutputData values = solution.GetCurrentValues();
+        if (solution.AppendCells(repeated, error) || solution.FindCell("ZZ1") != -1 || solution.GetCurrentValues() != values) {
+            std::cout << "    FAIL!!! a repeated name was appended" << std::endl;
+            return 1;
+        }
+    }
+
+    if (!test_add_delete(initial_data, modifications_medium_data, output_path, "") ||
+        !test_add_delete(generated.initial_data, generated.modifications_medium_data, output_path, "Generated")) {
+        return 1;
+    }
+
+    if (!test_journal(initial_data, modifications_medium_data, "") ||
+        !test_journal(generated.initial_data, generated.modifications_medium_data, "Generated")) {
+        return 1;
+    }
+
+    {
+        std::cout << std::endl << "FastSolution copy-on-write forks:" << std::endl;
+        FastSolution solution;
+        solution.InitialCalculate(initial_data);
+        const std::size_t forks_count = 200;
+        std::vector<SolutionFork> forks;
+        {
+            Timer timer("    Fork 1 call in average: ", forks_count);
+            for (std::size_t i = 0; i < forks_count; i++) {
+                forks.push_back(solution.Fork());
+            }
+        }
+        // Every fork is a scenario with its own edit, forks are edited in parallel.
+        std::vector<int> scenarios(forks_count);
+        std::iota(scenarios.begin(), scenarios.end(), 0);
+        auto edit_of = [&](int scenario) -> const InputCellInfo& {
+            return modifications_medium_data[scenario % modifications_medium_data.size()];
+        };
+        {
+            Timer timer("    [medium] ChangeCell of all forks in parallel: ");
+            std::for_each(std::execution::par, scenarios.begin(), scenarios.end(), [&](int scenario) {
+                const auto& edit = edit_of(scenario);
+                forks[scenario].ChangeCell(solution.FindCell(edit.name), edit.formula);
+            });
+        }
+        std::size_t owned_pages = 0, owned_bytes = 0;
+        for (const auto& it : forks) {
+            owned_pages += it.GetOwnedPagesCount();
+            owned_bytes += it.GetOwnedBytes();
+        }
+        std::cout << "    " << forks_count << " forks own " << owned_pages << " pages, " << owned_bytes / 1024 << " KB, "
+            << "a full copy of values is " << solution.GetIdsCount() * sizeof(ValueType) / 1024 << " KB" << std::endl;
+
+        // The same edits applied to the solution itself give the same values.
+        solution.EnableJournal(std::size_t(1) << 30);
+        bool forks_ok = true;
+        for (int scenario = 0; scenario < 10; scenario++) {
+            const auto& edit = edit_of(scenario);
+            solution.ChangeCell(edit.name, edit.formula);
+            auto values = solution.GetValues();
+            for (std::size_t cell = 0; cell < values.size(); cell++) {
+                forks_ok = forks_ok && values[cell] == forks[scenario].GetValue(cell);
+            }
+            solution.Undo();
+        }
+        // A fork of a fork has edits of both, its parent keeps only its own edit.
+        SolutionFork child = forks[0].Fork();
+        child.ChangeCell(solution.FindCell(edit_of(1).name), edit_of(1).formula);
+        solution.ChangeCell(edit_of(0).name, edit_of(0).formula);
+        auto values = solution.GetValues();
+        for (std::size_t cell = 0; cell < values.size(); cell++) {
+            forks_ok = forks_ok && values[cell] == forks[0].GetValue(cell);
+        }
+        solution.ChangeCell(edit_of(1).name, edit_of(1).formula);
+        values = solution.GetValues();
+        for (std::size_t cell = 0; cell < values.size(); cell++) {
+            forks_ok = forks_ok && values[cell] == child.GetValue(cell);
+        }
+        solution.Undo();
+        solution.Undo();
+        // The parent writes to pages which it shares with its child, the child keeps its values.
+        std::vector<ValueType> child_values;
+        for (std::size_t cell = 0; cell < values.size(); cell++) {
+            child_values.push_back(child.GetValue(cell));
+        }
+        for (int scenario = 2; scenario < 5; scenario++) {
+            forks[0].ChangeCell(solution.FindCell(edit_of(scenario).name), edit_of(scenario).formula);
+        }
+        for (std::size_t cell = 0; cell < values.size(); cell++) {
+            forks_ok = forks_ok && child.GetValue(cell) == child_values[cell];
+        }
+        // A fork taken after undo sees the state after it.
+        SolutionFork undone = solution.Fork();
+        values = solution.GetValues();
+        for (std::size_t cell = 0; cell < values.size(); cell++) {
+            forks_ok = forks_ok && values[cell] == undone.GetValue(cell);
+        }
+        if (!forks_ok) {
+            std::cout << "    FAIL!!! values of forks differ from values of the solution" << std::endl;
+            return 1;
+        }
+        std::cout << "    forks ok" << std::endl;
+    }
+
+    if (!test_scenarios(initial_data, modifications_medium_data, "") ||
+        !test_scenarios(generated.initial_data, generated.modifications_medium_data, "Generated")) {
+        return 1;
+    }
+
+    {
+        // Values are generated, so results don't depend on the test: 300K cells (1.2 MB, more than L2 cache)
+        // with random values, some of them are reference errors, so kernels check them too.
+        std::cout << std::endl << "Formula evaluation kernels, microbenchmark:" << std::endl;
+        std::mt19937 random(42);
+        std::vector<ValueType> values(300000);
+        for (std::size_t cell = 0; cell < values.size(); cell++) {
+            values[cell] = cell % 997 == 0 ? kReferenceError : ValueType(random() % 2001) - 1000;
+        }
+        // Random formulas of a given width over all cells, 1/4 of addends are values.
+        std::uniform_int_distribution<int> random_cell(0, (int) values.size() - 1);
+        bool kernels_ok = true;
+        for (int width : { 2, 4, 8, 12, 16, 32 }) {
+            std::vector<Formula> formulas(4096);
+            for (auto& formula : formulas) {
+                for (int i = 0; i < width; i++) {
+                    formula.push_back(random() % 4 == 0 ? Addend(Addend::VALUE, i) : Addend(Addend::CELL, random_cell(random)));
+                }
+            }
+            std::vector<ValueType> expected;
+            for (const auto& it : formulas) {
+                expected.push_back(SumFormulaScalar(it.data(), it.data() + it.size(), values.data()));
+            }
+            std::cout << "    " << width << " addends:";
+            for (const auto& kernel : GetSumFormulaKernels()) {
+                const std::size_t rounds = 256;
+                auto start = std::chrono::high_resolution_clock::now();
+                for (std::size_t round = 0; round < rounds; round++) {
+                    for (const auto& it : formulas) {
+                        kernel.function(it.data(), it.data() + it.size(), values.data());
+                    }
+                }
+                auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+                std::cout << " " << kernel.name << " " << (double) elapsed / (rounds * formulas.size()) << " ns";
+                for (std::size_t i = 0; i < formulas.size(); i++) {
+                    kernels_ok = kernels_ok &&
+                        kernel.function(formulas[i].data(), formulas[i].data() + formulas[i].size(), values.data()) == expected[i];
+                }
+            }
+            std::cout << " per cell, " << GetSumFormulaKernel(width).name << " is selected" << std::endl;
+        }
+        // Partial sums which wrap around to the reserved value don't change the result: it depends only
+        // on the exact sum of addends, in any order.
+        for (int width : { 3, 8, 17 }) {
+            Formula formula;
+            int64_t exact = 0;
+            for (int i = 0; i < width; i++) {
+                ValueType addend = i % 3 == 0 ? kMaxValue : (i % 3 == 1 ? 1 : -1);
+                formula.push_back(Addend(Addend::VALUE, addend));
+                exact += addend;
+            }
+            ValueType expected = (ValueType) (uint32_t) exact;
+            expected = expected == kReferenceError ? kMinValue : expected;
+            for (const auto& kernel : GetSumFormulaKernels()) {
+                kernels_ok = kernels_ok && kernel.function(formula.data(), formula.data() + formula.size(), values.data()) == expected;
+                std::reverse(formula.begin(), formula.end());
+                kernels_ok = kernels_ok && kernel.function(formula.data(), formula.data() + formula.size(), values.data()) == expected;
+            }
+        }
+        if (!kernels_ok) {
+            std::cout << "    FAIL!!! kernels give different values" << std::endl;
+            return 1;
+        }
+        std::cout << "    kernels ok" << std::endl;
+    }
+
+    {
+        // Test tiled solution, compare results to FastSolution's output.
+        Solution* solution = new TiledSolution();
+        bool success = test_solution(*solution, initial_data, modifications_small_data, modifications_medium_data, modifications_large_data,
+            output_path, "TiledSolution", "FastSolution");
+        delete solution;
+        if (!success) {
+            return 1;
+        }
+    }
+
+    {
+        // Tiles of the generated sheet depend on tiles of the same and the previous column.
+        Solution* solution = new TiledSolution();
+        bool success = test_solution(*solution, generated.initial_data, generated.modifications_small_data, generated.modifications_medium_data,
+            generated.modifications_large_data, output_path, "GeneratedTiledSolution", "GeneratedFastSolution");
         delete solution;
         if (!success) {
             return 1;
         }
     }
 
+    {
+        // Test critical path solution, compare results to FastSolution's output.
+        Solution* solution = new CriticalPathSolution();
+        bool success = test_solution(*solution, initial_data, modifications_small_data, modifications_medium_data, modifications_large_data,
+            output_path, "CriticalPathSolution", "FastSolution");
+        delete solution;
+        if (!success) {
+            return 1;
+        }
+    }
+
+    {
+        // Formulas of the generated sheet have 1 to 5 addends, so costs of paths differ.
+        Solution* solution = new CriticalPathSolution();
+        bool success = test_solution(*solution, generated.initial_data, generated.modifications_small_data, generated.modifications_medium_data,
+            generated.modifications_large_data, output_path, "GeneratedCriticalPathSolution", "GeneratedFastSolution");
+        delete solution;
+        if (!success) {
+            return 1;
+        }
+    }
+
+    {
+        // Test async solution, compare results to FastSolution's output.
+        Solution* solution = new AsyncSolution();
+        bool success = test_solution(*solution, initial_data, modifications_small_data, modifications_medium_data, modifications_large_data,
+            output_path, "AsyncSolution", "FastSolution");
+        delete solution;
+        if (!success) {
+            return 1;
+        }
+    }
+
+    {
+        // The service answers after a latency, so evaluations of the generated sheet are suspended and resumed
+        // by callbacks of the service thread.
+        Solution* solution = new AsyncSolution(std::chrono::microseconds(20));
+        bool success = test_solution(*solution, generated.initial_data, generated.modifications_small_data, generated.modifications_medium_data,
+            generated.modifications_large_data, output_path, "GeneratedAsyncSolution", "GeneratedFastSolution");
+        delete solution;
+        if (!success) {
+            return 1;
+        }
+    }
+
+    {
+        std::cout << std::endl << "Edits of unknown cells:" << std::endl;
+        OneThreadSimpleSolution one_thread_simple;
+        TiledSolution tiled;
+        CriticalPathSolution critical_path;
+        AsyncSolution async;
+        if (!test_unknown_cells(one_thread_simple, "OneThreadSimpleSolution") || !test_unknown_cells(tiled, "TiledSolution") ||
+            !test_unknown_cells(critical_path, "CriticalPathSolution") || !test_unknown_cells(async, "AsyncSolution")) {
+            return 1;
+        }
+    }
+
     return 0;
 }
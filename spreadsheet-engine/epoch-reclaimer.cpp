@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <thread>
+
+#include "epoch-reclaimer.h"
+
+EpochReclaimer::Guard::Guard(EpochReclaimer& reclaimer) : reclaimer(reclaimer), slot(reclaimer.Enter()) {}
+
+EpochReclaimer::Guard::~Guard() {
+    reclaimer.Leave(slot);
+}
+
+EpochReclaimer::EpochReclaimer() = default;
+
+EpochReclaimer::~EpochReclaimer() {
+    for (const auto& it : retired) {
+        it.deleter(it.object);
+    }
+}
+
+// The epoch is checked again after it is published in the slot. If the writer retired an object in between,
+// the reader takes the new epoch: the object was unlinked before, so the reader can't see it.
+// All operations are sequentially consistent, the writer either sees the slot or the reader sees the new epoch.
+int EpochReclaimer::Enter() {
+    for (int attempt = 0;; attempt++) {
+        int slot = attempt % kMaxReaders;
+        if (slot == 0 && attempt > 0) {
+            std::this_thread::yield();
+        }
+        uint64_t epoch = global_epoch.load();
+        uint64_t expected = 0;
+        if (!readers[slot].epoch.compare_exchange_strong(expected, epoch)) {
+            continue;
+        }
+        for (uint64_t current = global_epoch.load(); current != epoch; current = global_epoch.load()) {
+            epoch = current;
+            readers[slot].epoch.store(epoch);
+        }
+        return slot;
+    }
+}
+
+void EpochReclaimer::Leave(int slot) {
+    readers[slot].epoch.store(0, std::memory_order_release);
+}
+
+void EpochReclaimer::Retire(void* object, void (*deleter)(void*)) {
+    retired.push_back({ object, deleter, global_epoch.fetch_add(1) + 1 });
+}
+
+void EpochReclaimer::Reclaim() {
+    if (retired.empty()) {
+        return;
+    }
+    uint64_t min_epoch = global_epoch.load();
+    for (const auto& it : readers) {
+        uint64_t epoch = it.epoch.load();
+        if (epoch != 0) {
+            min_epoch = std::min(min_epoch, epoch);
+        }
+    }
+    // Objects are retired in order of epochs.
+    auto end = std::find_if(retired.begin(), retired.end(), [&](const RetiredObject& it) { return it.epoch > min_epoch; });
+    for (auto it = retired.begin(); it != end; it++) {
+        it->deleter(it->object);
+    }
+    retired.erase(retired.begin(), end);
+}
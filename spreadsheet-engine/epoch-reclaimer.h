@@ -0,0 +1,71 @@
+#ifndef SPREADSHEETENGINE_EPOCH_RECLAIMER_H
+#define SPREADSHEETENGINE_EPOCH_RECLAIMER_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Epoch-based reclamation of objects which are read by other threads without locks.
+//
+// A reader holds a Guard while it uses shared objects, the guard keeps the global epoch at the moment of entering.
+// The writer unlinks an object first (new readers can't find it), then retires it: the object is tagged
+// with the next epoch. Reclaim() frees retired objects whose tag is not greater than epochs of all active guards,
+// so an object is never freed while a reader which could see it is still running.
+// Retire() and Reclaim() are called by one writer thread, guards can be taken by any number of threads.
+class EpochReclaimer {
+public:
+    class Guard {
+    public:
+        explicit Guard(EpochReclaimer& reclaimer);
+        ~Guard();
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+    private:
+        EpochReclaimer& reclaimer;
+        int slot;
+    };
+
+    EpochReclaimer();
+    // Frees all retired objects, there should be no guards.
+    ~EpochReclaimer();
+
+    EpochReclaimer(const EpochReclaimer&) = delete;
+    EpochReclaimer& operator=(const EpochReclaimer&) = delete;
+
+    template <typename T>
+    void Retire(T* object) {
+        Retire(object, [](void* p) { delete static_cast<T*>(p); });
+    }
+    void Retire(void* object, void (*deleter)(void*));
+
+    // Frees retired objects which no reader can see.
+    void Reclaim();
+
+    std::size_t GetRetiredCount() const { return retired.size(); }
+
+private:
+    // More readers wait until a slot is released.
+    static const int kMaxReaders = 64;
+
+    // Epoch of the reader which holds the slot, 0 if the slot is free. Slots are on separate cache lines.
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch{0};
+    };
+
+    struct RetiredObject {
+        void* object;
+        void (*deleter)(void*);
+        uint64_t epoch;
+    };
+
+    std::atomic<uint64_t> global_epoch{1};
+    ReaderSlot readers[kMaxReaders];
+    std::vector<RetiredObject> retired;
+
+    int Enter();
+    void Leave(int slot);
+};
+
+#endif //SPREADSHEETENGINE_EPOCH_RECLAIMER_H
@@ -2,12 +2,19 @@
 #define SPREADSHEETENGINE_IO_DATA_H
 
 #include <iostream>
+#include <limits>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 #include <string>
 
 using ValueType = int;
+// Value of a cell whose formula references a deleted cell, it is written as "#REF!". Sums with it are errors too.
+// The value is reserved: readers reject it in formulas and a sum which lands on it is kMinValue (see SumValue()),
+// so values of cells are in [kMinValue, kMaxValue].
+const ValueType kReferenceError = std::numeric_limits<ValueType>::min();
+const ValueType kMinValue = kReferenceError + 1;
+const ValueType kMaxValue = std::numeric_limits<ValueType>::max();
 #define to_value_type(x) (ValueType) std::stoi(x);
 
 struct Addend {
@@ -55,4 +62,23 @@ struct InputCellInfo {
 using InputData = std::vector<InputCellInfo>;
 using OutputData = std::unordered_map<std::string, ValueType>;
 
+// Read-only view of a contiguous array without copying it (std::span is C++20).
+template <typename T>
+class Span {
+public:
+    Span() = default;
+    Span(const T* data, std::size_t size) : data_(data), size_(size) {}
+
+    const T* data() const { return data_; }
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const T* begin() const { return data_; }
+    const T* end() const { return data_ + size_; }
+    const T& operator[](std::size_t i) const { return data_[i]; }
+
+private:
+    const T* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
 #endif //SPREADSHEETENGINE_IO_DATA_H
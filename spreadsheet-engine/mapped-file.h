@@ -0,0 +1,31 @@
+#ifndef SPREADSHEETENGINE_MAPPED_FILE_H
+#define SPREADSHEETENGINE_MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of the whole file. File content is available without copying it into user buffers.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& file_path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool IsOpen() const { return is_open; }
+    const char* Data() const { return data; }
+    std::size_t Size() const { return size; }
+
+private:
+    bool is_open = false;
+    const char* data = nullptr;
+    std::size_t size = 0;
+
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#endif
+};
+
+#endif //SPREADSHEETENGINE_MAPPED_FILE_H
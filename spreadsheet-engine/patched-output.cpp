@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#include "patched-output.h"
+#include "mapped-file.h"
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <unistd.h>
+#endif
+
+const char PatchedOutputFile::kMagic[8] = { 'S', 'S', 'E', 'V', 'A', 'L', 'S', '1' };
+
+PatchedOutputFile::~PatchedOutputFile() {
+    Close();
+}
+
+#ifdef _WIN32
+
+bool PatchedOutputFile::Map(const std::string& file_path, std::size_t file_size) {
+    HANDLE file = CreateFileA(file_path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    file_handle = file;
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, (DWORD) ((uint64_t) file_size >> 32),
+                                        (DWORD) file_size, nullptr);
+    if (mapping == nullptr) {
+        return false;
+    }
+    mapping_handle = mapping;
+    data = (char*) MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, file_size);
+    return data != nullptr;
+}
+
+void PatchedOutputFile::Unmap() {
+    if (data != nullptr) {
+        UnmapViewOfFile(data);
+    }
+    if (mapping_handle != nullptr) {
+        CloseHandle(mapping_handle);
+        mapping_handle = nullptr;
+    }
+    if (file_handle != nullptr) {
+        CloseHandle(file_handle);
+        file_handle = nullptr;
+    }
+}
+
+void PatchedOutputFile::Flush() {
+    if (data != nullptr) {
+        FlushViewOfFile(data, size);
+        FlushFileBuffers(file_handle);
+    }
+}
+
+#else
+
+bool PatchedOutputFile::Map(const std::string& file_path, std::size_t file_size) {
+    int fd = open(file_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, file_size) != 0) {
+        close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    // Mapping stays valid after the descriptor is closed.
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    data = (char*) mapped;
+    return true;
+}
+
+void PatchedOutputFile::Unmap() {
+    if (data != nullptr) {
+        munmap(data, size);
+    }
+}
+
+void PatchedOutputFile::Flush() {
+    if (data != nullptr) {
+        msync(data, size, MS_SYNC);
+    }
+}
+
+#endif
+
+bool PatchedOutputFile::Create(const std::string& file_path, std::size_t records_count, std::size_t name_width) {
+    Close();
+    std::size_t record_size = name_width + 3 + kValueWidth + 1;
+    std::size_t file_size = sizeof(Header) + records_count * record_size;
+    size = file_size;
+    if (!Map(file_path, file_size)) {
+        Close();
+        return false;
+    }
+
+    this->records_count = records_count;
+    this->capacity = records_count;
+    this->name_width = name_width;
+    this->record_size = record_size;
+
+    Header* header = new (data) Header();
+    std::memcpy(header->magic, kMagic, sizeof(kMagic));
+    header->version.store(0, std::memory_order_relaxed);
+    header->records_count.store(records_count, std::memory_order_relaxed);
+    header->name_width = (uint32_t) name_width;
+    header->record_size = (uint32_t) record_size;
+    std::memset(header->padding, ' ', sizeof(header->padding));
+    header->new_line = '\n';
+    return true;
+}
+
+void PatchedOutputFile::Close() {
+    Unmap();
+    data = nullptr;
+    size = 0;
+    records_count = 0;
+    capacity = 0;
+}
+
+void PatchedOutputFile::FormatValue(char* field, ValueType value) {
+    char digits[kValueWidth];
+    char* end = value == kReferenceError ? std::copy_n("#REF!", 5, digits) : std::to_chars(digits, digits + kValueWidth, value).ptr;
+    std::size_t length = end - digits;
+    std::memset(field, ' ', kValueWidth - length);
+    std::memcpy(field + kValueWidth - length, digits, length);
+}
+
+void PatchedOutputFile::SetRecord(std::size_t record, std::string_view name, ValueType value) {
+    char* line = GetRecord(record);
+    std::size_t length = std::min(name.size(), name_width);
+    std::memcpy(line, name.data(), length);
+    std::memset(line + length, ' ', name_width - length);
+    std::memcpy(line + name_width, " = ", 3);
+    FormatValue(line + name_width + 3, value);
+    line[record_size - 1] = '\n';
+}
+
+void PatchedOutputFile::BeginUpdate() {
+    Header* header = GetHeader();
+    header->version.store(header->version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void PatchedOutputFile::SetValue(std::size_t record, ValueType value) {
+    FormatValue(GetRecord(record) + name_width + 3, value);
+}
+
+void PatchedOutputFile::EndUpdate() {
+    Header* header = GetHeader();
+    header->version.store(header->version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void PatchedOutputFile::RemoveRecord(std::size_t record) {
+    BeginUpdate();
+    std::memmove(GetRecord(record), GetRecord(record + 1), (records_count - record - 1) * record_size);
+    records_count--;
+    GetHeader()->records_count.store(records_count, std::memory_order_relaxed);
+    EndUpdate();
+}
+
+bool PatchedOutputFile::InsertRecord(std::size_t record, std::string_view name, ValueType value) {
+    if (records_count == capacity || name.size() > name_width) {
+        return false;
+    }
+    BeginUpdate();
+    std::memmove(GetRecord(record + 1), GetRecord(record), (records_count - record) * record_size);
+    SetRecord(record, name, value);
+    records_count++;
+    GetHeader()->records_count.store(records_count, std::memory_order_relaxed);
+    EndUpdate();
+    return true;
+}
+
+uint64_t PatchedOutputFile::Version() const {
+    return data != nullptr ? GetHeader()->version.load(std::memory_order_acquire) : 0;
+}
+
+bool PatchedOutputFile::Read(const std::string& file_path, std::vector<std::pair<std::string, ValueType>>& records,
+                             uint64_t& version, std::chrono::milliseconds timeout) {
+    MappedFile file(file_path);
+    if (!file.IsOpen() || file.Size() < sizeof(Header)) {
+        return false;
+    }
+    const Header* header = (const Header*) file.Data();
+    if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->record_size != header->name_width + 3 + kValueWidth + 1 ||
+        (file.Size() - sizeof(Header)) % header->record_size != 0) {
+        return false;
+    }
+    std::size_t capacity = (file.Size() - sizeof(Header)) / header->record_size;
+
+    // The number of records is changed by removals and insertions, so it is read under the seqlock too.
+    std::vector<char> content;
+    std::size_t records_count = 0;
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+        uint64_t begin_version = header->version.load(std::memory_order_acquire);
+        if (begin_version % 2 == 0) {
+            records_count = std::min<std::size_t>(header->records_count.load(std::memory_order_relaxed), capacity);
+            content.assign(file.Data() + sizeof(Header), file.Data() + sizeof(Header) + records_count * header->record_size);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (header->version.load(std::memory_order_relaxed) == begin_version) {
+                version = begin_version;
+                break;
+            }
+        }
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::yield();
+    }
+
+    records.resize(records_count);
+    for (std::size_t i = 0; i < records.size(); i++) {
+        const char* line = content.data() + i * header->record_size;
+        std::size_t name_length = header->name_width;
+        while (name_length > 0 && line[name_length - 1] == ' ') {
+            name_length--;
+        }
+        const char* value = line + header->name_width + 3;
+        const char* value_end = value + kValueWidth;
+        while (value < value_end && *value == ' ') {
+            value++;
+        }
+        records[i].first.assign(line, name_length);
+        if (std::from_chars(value, value_end, records[i].second).ec != std::errc()) {
+            records[i].second = kReferenceError;
+        }
+    }
+    return true;
+}
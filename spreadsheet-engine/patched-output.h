@@ -0,0 +1,97 @@
+#ifndef SPREADSHEETENGINE_PATCHED_OUTPUT_H
+#define SPREADSHEETENGINE_PATCHED_OUTPUT_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "io-data.h"
+
+// Output file which is kept memory mapped and patched in place. Every cell has a fixed-width text record
+// "<name padded by spaces> = <value aligned to the right>\n", so the value of a record is rewritten without
+// moving the rest of the file.
+//
+// The file starts with a binary header which contains the version of the content. The version is odd while
+// records are patched (seqlock), so a reader which copied records between two equal even versions has
+// a consistent state. Read() is such a reader.
+//
+// Records are removed and inserted in place: records after them are moved under the same seqlock, the file keeps
+// the space of removed records at its end and the number of valid records is in the header.
+class PatchedOutputFile {
+public:
+    PatchedOutputFile() = default;
+    ~PatchedOutputFile();
+
+    PatchedOutputFile(const PatchedOutputFile&) = delete;
+    PatchedOutputFile& operator=(const PatchedOutputFile&) = delete;
+
+    // Creates the file of 'records_count' records with names of at most 'name_width' characters.
+    // All records should be filled by SetRecord() then.
+    bool Create(const std::string& file_path, std::size_t records_count, std::size_t name_width);
+    void Close();
+    bool IsOpen() const { return data != nullptr; }
+
+    // Can run in parallel for different records.
+    void SetRecord(std::size_t record, std::string_view name, ValueType value);
+
+    // Values are changed by SetValue() calls between BeginUpdate() and EndUpdate(), SetValue() calls
+    // can run in parallel for different records.
+    void BeginUpdate();
+    void SetValue(std::size_t record, ValueType value);
+    void EndUpdate();
+
+    // Both move records after 'record' and bump the version. InsertRecord() returns false without changes if
+    // the name is longer than the records or the file has no space left, the file should be created again then.
+    void RemoveRecord(std::size_t record);
+    bool InsertRecord(std::size_t record, std::string_view name, ValueType value);
+
+    std::size_t RecordsCount() const { return records_count; }
+    uint64_t Version() const;
+
+    // Writes the mapped pages to the disk. Readers of the file see the changes without it.
+    void Flush();
+
+    // Reads names and values of all records, retries if the file was being patched. Returns false if the file is not valid
+    // or no consistent copy was taken during 'timeout' (e.g. the writer died in the middle of an update).
+    static bool Read(const std::string& file_path, std::vector<std::pair<std::string, ValueType>>& records, uint64_t& version,
+                     std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+
+private:
+    struct Header {
+        char magic[8];
+        std::atomic<uint64_t> version;
+        std::atomic<uint64_t> records_count;
+        uint32_t name_width;
+        uint32_t record_size;
+        // Header size is a multiple of 8, the last byte is '\n', so records start from a new line.
+        char padding[31];
+        char new_line;
+    };
+
+    static const char kMagic[8];
+    static const std::size_t kValueWidth = 11;
+
+    char* data = nullptr;
+    std::size_t size = 0;
+    std::size_t records_count = 0;
+    std::size_t capacity = 0;
+    std::size_t name_width = 0;
+    std::size_t record_size = 0;
+
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#endif
+
+    Header* GetHeader() const { return (Header*) data; }
+    char* GetRecord(std::size_t record) const { return data + sizeof(Header) + record * record_size; }
+    static void FormatValue(char* field, ValueType value);
+
+    bool Map(const std::string& file_path, std::size_t file_size);
+    void Unmap();
+};
+
+#endif //SPREADSHEETENGINE_PATCHED_OUTPUT_H
@@ -0,0 +1,71 @@
+#include <algorithm>
+#include <execution>
+#include <numeric>
+
+#include "radix-sort.h"
+#include "utils.h"
+
+static const int kRadixBits = 8;
+static const int kRadix = 1 << kRadixBits;
+// Smaller arrays are not split into parts.
+static const std::size_t kMinPartSize = 1 << 16;
+
+void ParallelRadixSort(std::vector<uint64_t>& keys, std::vector<int>& ids) {
+    std::size_t n = keys.size();
+    if (n < 2) {
+        return;
+    }
+
+    // Bits which are not the same in all keys
+    uint64_t all_and = ~(uint64_t) 0, all_or = 0;
+    for (uint64_t key : keys) {
+        all_and &= key;
+        all_or |= key;
+    }
+    uint64_t different_bits = all_and ^ all_or;
+
+    std::size_t parts_count = std::max<std::size_t>(1, std::min<std::size_t>(get_threads_count(), n / kMinPartSize));
+    std::vector<int> parts(parts_count);
+    std::iota(parts.begin(), parts.end(), 0);
+    auto part_begin = [&](std::size_t part) { return n * part / parts_count; };
+
+    std::vector<uint64_t> keys_buffer(n);
+    std::vector<int> ids_buffer(n);
+    // offsets[part * kRadix + digit] - position of the next element with 'digit' from 'part'.
+    std::vector<std::size_t> offsets(parts_count * kRadix);
+
+    for (int shift = 0; shift < 64; shift += kRadixBits) {
+        if (((different_bits >> shift) & (kRadix - 1)) == 0) {
+            continue;
+        }
+
+        std::fill(offsets.begin(), offsets.end(), 0);
+        std::for_each(std::execution::par_unseq, parts.begin(), parts.end(), [&](int part) {
+            std::size_t* counts = &offsets[part * kRadix];
+            for (std::size_t i = part_begin(part); i < part_begin(part + 1); i++) {
+                counts[(keys[i] >> shift) & (kRadix - 1)]++;
+            }
+        });
+
+        // Elements of digit d go after all smaller digits, and elements of a part after ones of previous parts.
+        std::size_t position = 0;
+        for (int digit = 0; digit < kRadix; digit++) {
+            for (std::size_t part = 0; part < parts_count; part++) {
+                std::size_t count = offsets[part * kRadix + digit];
+                offsets[part * kRadix + digit] = position;
+                position += count;
+            }
+        }
+
+        std::for_each(std::execution::par_unseq, parts.begin(), parts.end(), [&](int part) {
+            std::size_t* next = &offsets[part * kRadix];
+            for (std::size_t i = part_begin(part); i < part_begin(part + 1); i++) {
+                std::size_t to = next[(keys[i] >> shift) & (kRadix - 1)]++;
+                keys_buffer[to] = keys[i];
+                ids_buffer[to] = ids[i];
+            }
+        });
+        keys.swap(keys_buffer);
+        ids.swap(ids_buffer);
+    }
+}
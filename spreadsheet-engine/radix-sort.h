@@ -0,0 +1,12 @@
+#ifndef SPREADSHEETENGINE_RADIX_SORT_H
+#define SPREADSHEETENGINE_RADIX_SORT_H
+
+#include <cstdint>
+#include <vector>
+
+// Stable LSD radix sort of ids by 64-bit keys, keys[i] is the key of ids[i]. Both arrays are sorted.
+// A pass is made only for bytes which are different in some keys, so small keys take a few passes.
+// Every pass counts and scatters its own part of the array in each thread.
+void ParallelRadixSort(std::vector<uint64_t>& keys, std::vector<int>& ids);
+
+#endif //SPREADSHEETENGINE_RADIX_SORT_H
@@ -1,8 +1,23 @@
 #include <iostream>
 #include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <atomic>
+#include <exception>
+#include <mutex>
 #include "reader.h"
+#include "mapped-file.h"
 #include "utils.h"
 
+#if defined(__SSE2__) || defined(_M_X64)
+  #include <emmintrin.h>
+  #define READER_USE_SSE2
+#endif
+
+#ifdef _MSC_VER
+  #include <intrin.h>
+#endif
+
 using Tokens = std::vector<std::string>;
 
 Tokens split(const std::string& s, char delimiter) {
@@ -33,7 +48,7 @@ bool validate_cell(const std::string& s) {
 }
 
 
-InputData Reader::Read(std::ifstream& input_file, std::unordered_map<std::string, int>& ids) {
+InputData Reader::Read(std::ifstream& input_file, CellIds& ids) {
     std::string line;
     InputData input_data = InputData();
     int line_num = 1;
@@ -43,7 +58,7 @@ InputData Reader::Read(std::ifstream& input_file, std::unordered_map<std::string
         if (tokens.size() != 2) {
             throw ParserException("Unable to find \'=\' in line " + std::to_string(line_num));
         }
-        const std::string& cell = tokens[0];
+        std::string& cell = tokens[0];
         if (!validate_cell(cell)) {
             throw ParserException("Wrong cell format " + cell);
         }
@@ -51,13 +66,7 @@ InputData Reader::Read(std::ifstream& input_file, std::unordered_map<std::string
             throw ParserException("Cell  " + tokens[0] + " initialized twice");
         }*/
 
-        int id;
-        if (ids.find(cell) == ids.end()) {
-            id = ids.size();
-            ids[cell] = ids.size();
-        } else {
-            id = ids[cell];
-        }
+        int id = ids.Intern(cell);
 
         // Parse formula
         Tokens addend_tokens = split(tokens[1], '+');
@@ -65,35 +74,308 @@ InputData Reader::Read(std::ifstream& input_file, std::unordered_map<std::string
         for (const auto& it : addend_tokens) {
             if (validate_cell(it)) {
 
-                int next_id;
-                if (ids.find(it) == ids.end()) {
-                    next_id = ids.size();
-                    ids[it] = ids.size();
-                } else {
-                    next_id = ids[it];
-                }
+                int next_id = ids.Intern(it);
 
                 f.push_back(AddendFactory::CellAddend(next_id));
             } else {
+                int value;
                 try {
-                    f.push_back(AddendFactory::ValueAddend(std::stoi(it)));
+                    value = std::stoi(it);
                 }
                 catch (std::exception& e) {
                     throw ParserException("Addend " + it + " is not cell or value");
                 }
+                if (value == kReferenceError) {
+                    throw ParserException("Value " + it + " is reserved for reference errors");
+                }
+                f.push_back(AddendFactory::ValueAddend(value));
             }
         }
 
         InputCellInfo info;
 
         info.id = id;
-        info.name = cell;
-        info.formula = f;
+        info.name = std::move(cell);
+        info.formula = std::move(f);
         
-        input_data.push_back(info);
+        input_data.push_back(std::move(info));
         //input_data[input_data_id++] = CellInfoIO(id, cell, f);
         line_num++;
     }
     return input_data;
 }
 
+// -------------- Memory mapped reader --------------
+
+inline int count_trailing_zeros(unsigned int x) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return (int) index;
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+// Returns position of the first '\n' in [begin, end) or end. 16 bytes are compared at once.
+static const char* find_line_end(const char* begin, const char* end) {
+    const char* p = begin;
+#ifdef READER_USE_SSE2
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*) p);
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+        if (mask != 0) {
+            return p + count_trailing_zeros(mask);
+        }
+        p += 16;
+    }
+#endif
+    const void* found = std::memchr(p, '\n', end - p);
+    return found != nullptr ? (const char*) found : end;
+}
+
+inline const char* skip_spaces(const char* p, const char* end) {
+    while (p != end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+// Correct cell format is ['A'-'Z'] ['0'-'9']+. Returns the end of the name or nullptr.
+inline const char* parse_cell_name(const char* p, const char* end) {
+    if (p == end || *p < 'A' || *p > 'Z') {
+        return nullptr;
+    }
+    const char* q = p + 1;
+    while (q != end && '0' <= *q && *q <= '9') {
+        q++;
+    }
+    return q - p > 1 ? q : nullptr;
+}
+
+// Parses 'cell =' part of the line. Returns position after '='.
+static const char* parse_cell_definition(const char* begin, const char* end, int line_num,
+                                         const char*& name_begin, const char*& name_end) {
+    const char* equal_sign = (const char*) std::memchr(begin, '=', end - begin);
+    if (equal_sign == nullptr) {
+        throw ParserException("Unable to find \'=\' in line " + std::to_string(line_num));
+    }
+
+    name_begin = skip_spaces(begin, equal_sign);
+    name_end = parse_cell_name(name_begin, equal_sign);
+    if (name_end == nullptr || skip_spaces(name_end, equal_sign) != equal_sign) {
+        throw ParserException("Wrong cell format " + std::string(begin, equal_sign));
+    }
+    return equal_sign + 1;
+}
+
+// Parses 'addend + addend + ...' part of the line into 'formula'. 'cell_id' returns id of a cell by its name.
+// Names are passed as views into the file, ids are found without copying them.
+template <typename CellId>
+static void parse_formula(const char* p, const char* end, Formula& formula, CellId cell_id) {
+    formula.reserve(std::count(p, end, '+') + 1);
+    while (true) {
+        p = skip_spaces(p, end);
+        const char* addend_begin = p;
+        const char* cell_end = parse_cell_name(p, end);
+        if (cell_end != nullptr) {
+            formula.push_back(AddendFactory::CellAddend(cell_id(std::string_view(p, cell_end - p))));
+            p = cell_end;
+        } else {
+            ValueType value;
+            auto result = std::from_chars(p, end, value);
+            if (result.ec != std::errc()) {
+                throw ParserException("Addend " + std::string(addend_begin, end) + " is not cell or value");
+            }
+            if (value == kReferenceError) {
+                throw ParserException("Value " + std::string(addend_begin, result.ptr) + " is reserved for reference errors");
+            }
+            formula.push_back(AddendFactory::ValueAddend(value));
+            p = result.ptr;
+        }
+
+        p = skip_spaces(p, end);
+        if (p == end) {
+            break;
+        }
+        if (*p != '+') {
+            throw ParserException("Addend " + std::string(addend_begin, end) + " is not cell or value");
+        }
+        p++;
+    }
+}
+
+static void parse_line(const char* begin, const char* end, int line_num, CellIds& ids, InputCellInfo& info) {
+    const char* name_begin;
+    const char* name_end;
+    const char* formula_begin = parse_cell_definition(begin, end, line_num, name_begin, name_end);
+    info.name.assign(name_begin, name_end);
+    info.id = ids.Intern(info.name);
+    parse_formula(formula_begin, end, info.formula, [&](std::string_view name) { return ids.Intern(name); });
+}
+
+InputData Reader::ReadMapped(const std::string& input_file_path, CellIds& ids) {
+    MappedFile file(input_file_path);
+    if (!file.IsOpen()) {
+        throw ParserException("Unable to open file " + input_file_path);
+    }
+
+    InputData input_data = InputData();
+    const char* p = file.Data();
+    const char* end = p + file.Size();
+    int line_num = 1;
+    while (p != end) {
+        const char* line_end = find_line_end(p, end);
+        input_data.emplace_back();
+        parse_line(p, line_end, line_num, ids, input_data.back());
+        p = line_end == end ? end : line_end + 1;
+        line_num++;
+    }
+    return input_data;
+}
+
+// -------------- Streaming reader of the initial file --------------
+
+void Reader::ReadStreaming(const std::string& input_file_path, CellIds& ids,
+                           const std::function<void(int)>& begin, const std::function<void(InputCellInfo&)>& consume) {
+    MappedFile file(input_file_path);
+    if (!file.IsOpen()) {
+        throw ParserException("Unable to open file " + input_file_path);
+    }
+    const char* p = file.Data();
+    const char* end = p + file.Size();
+
+    // Every cell is defined in its own line, so the number of cells is known before parsing.
+    int cells_count = 0;
+    for (const char* it = p; it != end; cells_count++) {
+        it = find_line_end(it, end);
+        it = it == end ? end : it + 1;
+    }
+    if (ids.Size() != 0) {
+        throw ParserException("Initial file should be read first");
+    }
+    begin(cells_count);
+
+    // Ids are given in order of appearance, so a cell which is used before its definition gets id before it is defined.
+    // All ids are less than cells_count if every cell is defined once.
+    std::vector<bool> is_defined(cells_count, false);
+    int line_num = 1;
+    while (p != end) {
+        const char* line_end = find_line_end(p, end);
+        InputCellInfo info;
+        parse_line(p, line_end, line_num, ids, info);
+        if (ids.Size() > (std::size_t) cells_count) {
+            throw ParserException("Line " + std::to_string(line_num) + " contains a cell which is not initialized");
+        }
+        if (is_defined[info.id]) {
+            throw ParserException("Cell " + info.name + " initialized twice");
+        }
+        is_defined[info.id] = true;
+        consume(info);
+
+        p = line_end == end ? end : line_end + 1;
+        line_num++;
+    }
+}
+
+// -------------- Parallel reader of the initial file --------------
+
+InputData Reader::ReadInitialParallel(const std::string& input_file_path, CellIds& ids) {
+    MappedFile file(input_file_path);
+    if (!file.IsOpen()) {
+        throw ParserException("Unable to open file " + input_file_path);
+    }
+    const char* data = file.Data();
+    const char* data_end = data + file.Size();
+
+    // Split the file into chunks at line boundaries, there are more chunks than threads for load balancing.
+    std::size_t chunks_count = std::max<std::size_t>(1, std::min<std::size_t>(get_threads_count() * 4, file.Size() / 4096));
+    std::vector<const char*> chunk_begin(chunks_count + 1, data_end);
+    chunk_begin[0] = data;
+    for (std::size_t i = 1; i < chunks_count; i++) {
+        const char* p = std::max(chunk_begin[i - 1], data + file.Size() * i / chunks_count);
+        if (p != data && p != data_end && p[-1] != '\n') {
+            p = find_line_end(p, data_end);
+            p = p == data_end ? p : p + 1;
+        }
+        chunk_begin[i] = p;
+    }
+
+    // Every thread takes the next chunk until all chunks are processed. The first exception is rethrown.
+    std::exception_ptr error = nullptr;
+    std::mutex error_mutex;
+    auto for_each_chunk = [&](const std::function<void(std::size_t)>& job) {
+        std::atomic<std::size_t> next_chunk{0};
+        runMultipleThreads([&]() {
+            for (std::size_t chunk = next_chunk++; chunk < chunks_count; chunk = next_chunk++) {
+                try {
+                    job(chunk);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                }
+            }
+        });
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    };
+
+    // Number of lines in chunks, then the number of the first line of every chunk
+    std::vector<int> first_line(chunks_count + 1, 0);
+    for_each_chunk([&](std::size_t chunk) {
+        int lines = 0;
+        for (const char* p = chunk_begin[chunk]; p != chunk_begin[chunk + 1]; lines++) {
+            p = find_line_end(p, chunk_begin[chunk + 1]);
+            p = p == chunk_begin[chunk + 1] ? p : p + 1;
+        }
+        first_line[chunk + 1] = lines;
+    });
+    for (std::size_t i = 0; i < chunks_count; i++) {
+        first_line[i + 1] += first_line[i];
+    }
+
+    // Cells get ids by numbers of lines
+    if (ids.Size() != 0) {
+        throw ParserException("Initial file should be read first");
+    }
+    InputData input_data(first_line[chunks_count]);
+    ids.Reserve(input_data.size());
+    std::vector<const char*> formula_begin(input_data.size());
+    std::vector<const char*> line_end(input_data.size());
+    for_each_chunk([&](std::size_t chunk) {
+        int line = first_line[chunk];
+        for (const char* p = chunk_begin[chunk]; p != chunk_begin[chunk + 1]; line++) {
+            line_end[line] = find_line_end(p, chunk_begin[chunk + 1]);
+            const char* name_begin;
+            const char* name_end;
+            formula_begin[line] = parse_cell_definition(p, line_end[line], line + 1, name_begin, name_end);
+
+            InputCellInfo& info = input_data[line];
+            info.id = line;
+            info.name.assign(name_begin, name_end);
+            if (!ids.Insert(info.name, line)) {
+                throw ParserException("Cell " + info.name + " initialized twice");
+            }
+            p = line_end[line] == chunk_begin[chunk + 1] ? line_end[line] : line_end[line] + 1;
+        }
+    });
+
+    // All cells are known, parse formulas
+    for_each_chunk([&](std::size_t chunk) {
+        for (int line = first_line[chunk]; line < first_line[chunk + 1]; line++) {
+            parse_formula(formula_begin[line], line_end[line], input_data[line].formula, [&](std::string_view name) {
+                int id = ids.Find(name);
+                if (id == -1) {
+                    throw ParserException("Cell " + std::string(name) + " is not initialized");
+                }
+                return id;
+            });
+        }
+    });
+
+    return input_data;
+}
@@ -3,7 +3,9 @@
 
 #include <iostream>
 #include <fstream>
+#include <functional>
 #include "io-data.h"
+#include "cell-ids.h"
 
 class ParserException: public std::exception {
 private:
@@ -20,7 +22,23 @@ public:
 
 class Reader {
 public:
-    static InputData Read(std::ifstream& input_file, std::unordered_map<std::string, int>& ids);
+    static InputData Read(std::ifstream& input_file, CellIds& ids);
+
+    // The same result as Read(), but the file is memory mapped and parsed in place: lines are found by SIMD scan,
+    // names and numbers are parsed without temporary strings and exceptions, formulas are written straight into
+    // the result. Cell ids are assigned in the same order as Read() does.
+    static InputData ReadMapped(const std::string& input_file_path, CellIds& ids);
+
+    // Parses the initial file and passes cells to 'consume' one by one, so the caller can process them while the rest
+    // of the file is being parsed. 'begin' is called with the number of cells before the first cell. Ids are assigned
+    // the same way as ReadMapped() does and all of them are less than the number of cells.
+    static void ReadStreaming(const std::string& input_file_path, CellIds& ids,
+                              const std::function<void(int)>& begin, const std::function<void(InputCellInfo&)>& consume);
+
+    // Reads the initial file in parallel. The file is split into chunks at line boundaries. Id of a cell is the number
+    // of the line where it is defined, so ids don't depend on the order of chunks and the result is sorted by id.
+    // Every cell should be defined once and all cells in formulas should be defined.
+    static InputData ReadInitialParallel(const std::string& input_file_path, CellIds& ids);
 };
 
 #endif //SPREADSHEETENGINE_READER_H
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <numeric>
+
+#include "async.h"
+#include "../utils.h"
+
+AsyncSolution::AsyncSolution(std::chrono::microseconds latency) : service(new ExternalService(latency)) {}
+
+// -------------- Values calculation --------------
+
+// Adds the next addend by the external call, the callback resumes evaluation in one of worker threads.
+void AsyncSolution::Resume(Evaluation evaluation) {
+    const auto& formula = cells[evaluation.cell].formula;
+    if (evaluation.addend == formula.size()) {
+        CompleteCell(evaluation.cell, SumValue(evaluation.value));
+        return;
+    }
+
+    const auto& it = formula[evaluation.addend++];
+    ValueType addend = it.type == Addend::CELL ? cells[it.value].value : it.value;
+    service->Sum(evaluation.value, addend, [this, evaluation](SumType value) mutable {
+        evaluation.value = value;
+        evaluations.enqueue(evaluation);
+    });
+}
+
+void AsyncSolution::CompleteCell(int cell, ValueType value) {
+    auto& info = cells[cell];
+    info.value = value;
+    for (const auto& next : info.dependencies) {
+        auto& next_info = cells[next];
+        if (next_info.epoch == epoch && next_info.unresolved_cells_count.fetch_sub(1) == 1) {
+            evaluations.enqueue({ next, 0, 0 });
+        }
+    }
+    calculated_cells_count++;
+}
+
+void AsyncSolution::CalculateCellsThreadJob() {
+    Evaluation evaluation;
+    while (calculated_cells_count.load() < cells_to_calculate) {
+        // Don't spin: while all evaluations are suspended the service thread needs CPU.
+        if (evaluations.wait_dequeue_timed(evaluation, std::chrono::milliseconds(1))) {
+            Resume(evaluation);
+        }
+    }
+}
+
+// Calculates all cells of the current epoch.
+void AsyncSolution::CalculateCells(const std::vector<int>& cells_list) {
+    cells_to_calculate = cells_list.size();
+    calculated_cells_count = 0;
+    for (const auto& cell : cells_list) {
+        int cnt = 0;
+        for (const auto& it : cells[cell].formula) {
+            cnt += it.type == Addend::CELL && cells[it.value].epoch == epoch;
+        }
+        cells[cell].unresolved_cells_count.store(cnt);
+        if (cnt == 0) {
+            evaluations.enqueue({ cell, 0, 0 });
+        }
+    }
+
+    runMultipleThreads([&]() { CalculateCellsThreadJob(); });
+}
+
+void AsyncSolution::InitialCalculate(const InputData& input_data) {
+    cells = std::vector<CellInfo>(input_data.size());
+    ids.Clear();
+    ids.Reserve(input_data.size());
+    for (const auto& it : input_data) {
+        cells[it.id].formula = it.formula;
+        ids.Insert(it.name, it.id);
+    }
+
+    epoch++;
+    for (std::size_t cell = 0; cell < cells.size(); cell++) {
+        cells[cell].epoch = epoch;
+        for (const auto& it : cells[cell].formula) {
+            if (it.type == Addend::CELL) {
+                cells[it.value].dependencies.push_back(cell);
+            }
+        }
+    }
+
+    std::vector<int> all_cells(cells.size());
+    std::iota(all_cells.begin(), all_cells.end(), 0);
+    CalculateCells(all_cells);
+}
+
+// -------------- Change formula of a cell --------------
+
+void AsyncSolution::ChangeCell(const std::string& cell, const Formula& formula) {
+    int cell_id = ids.Find(cell);
+    if (!IsKnownEdit(cell_id, formula, cells.size())) {
+        return;
+    }
+    for (const auto& it : cells[cell_id].formula) {
+        if (it.type == Addend::CELL) {
+            auto& dependencies = cells[it.value].dependencies;
+            dependencies.erase(std::find(dependencies.begin(), dependencies.end(), cell_id));
+        }
+    }
+    cells[cell_id].formula = formula;
+    for (const auto& it : formula) {
+        if (it.type == Addend::CELL) {
+            cells[it.value].dependencies.push_back(cell_id);
+        }
+    }
+
+    // Mark all cells which are reachable from the changed one
+    epoch++;
+    std::vector<int> reachable = { cell_id };
+    cells[cell_id].epoch = epoch;
+    for (std::size_t i = 0; i < reachable.size(); i++) {
+        for (const auto& next : cells[reachable[i]].dependencies) {
+            if (cells[next].epoch != epoch) {
+                cells[next].epoch = epoch;
+                reachable.push_back(next);
+            }
+        }
+    }
+
+    CalculateCells(reachable);
+}
+
+// -------------- Return current state of cells --------------
+
+OutputData AsyncSolution::GetCurrentValues() {
+    OutputData result = OutputData();
+    for (std::size_t cell = 0; cell < cells.size(); cell++) {
+        result[ids.GetName(cell)] = cells[cell].value;
+    }
+    return result;
+}
@@ -0,0 +1,69 @@
+#ifndef SPREADSHEETENGINE_ASYNC_H
+#define SPREADSHEETENGINE_ASYNC_H
+
+#include <atomic>
+#include <memory>
+
+#include "solution.h"
+#include "../cell-ids.h"
+#include "external-service.h"
+#include "../lock-free-queue/blockingconcurrentqueue.h"
+
+// Solution for formulas which call slow external functions (every sum is a call to ExternalService).
+// Evaluation of a cell is a continuation: it is suspended while the service computes the next sum
+// and resumed by the service callback, which pushes it back to the queue. Worker threads never wait
+// for the service, they take other evaluations from the queue, so thousands of slow calls overlap
+// without thousands of threads.
+class AsyncSolution : public Solution {
+private:
+
+    struct CellInfo {
+        CellInfo() = default;
+        CellInfo(const CellInfo& other) : formula(other.formula) {}
+
+        Formula formula;
+        ValueType value = 0;
+        // Cells which contain this cell in formula.
+        std::vector<int> dependencies;
+
+        std::atomic<int> unresolved_cells_count{0};
+        // Equals to 'epoch' if cell should be calculated by the current calculation.
+        int epoch = 0;
+    };
+
+    // Suspended evaluation of a cell: 'addend' addends are already summed up into 'value'.
+    struct Evaluation {
+        int cell;
+        std::size_t addend;
+        SumType value;
+    };
+
+    std::vector<CellInfo> cells;
+    CellIds ids;
+    int epoch = 0;
+
+    std::unique_ptr<ExternalService> service;
+
+    moodycamel::BlockingConcurrentQueue<Evaluation> evaluations;
+    std::atomic<int> calculated_cells_count;
+    int cells_to_calculate = 0;
+
+    void Resume(Evaluation evaluation);
+    void CompleteCell(int cell, ValueType value);
+    void CalculateCellsThreadJob();
+    void CalculateCells(const std::vector<int>& cells_list);
+
+public:
+
+    explicit AsyncSolution(std::chrono::microseconds latency = std::chrono::milliseconds(milliseconds));
+
+    // Time complexity is O(n) where n - number of vertices in input_data.
+    void InitialCalculate(const InputData& input_data) override;
+
+    // Time complexity is O(t) where t - total number of cells which are depended on 'cell'.
+    void ChangeCell(const std::string& cell, const Formula& formula) override;
+
+    OutputData GetCurrentValues() override;
+};
+
+#endif //SPREADSHEETENGINE_ASYNC_H
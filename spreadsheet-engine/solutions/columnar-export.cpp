@@ -0,0 +1,46 @@
+#include "columnar-export.h"
+
+bool ColumnarExport::Write(const std::string& file_path, const std::vector<uint64_t>& name_offsets, const std::vector<char>& names,
+                           Span<ValueType> values, Span<int> changed_cells) {
+    SnapshotWriter writer(kVersion);
+    writer.AddSection(name_offsets);
+    writer.AddSection(names);
+    writer.AddSection(values.data(), values.size());
+    writer.AddSection(changed_cells.data(), changed_cells.size());
+    return writer.Write(file_path);
+}
+
+ColumnarReader::ColumnarReader(const std::string& file_path) :
+    reader(file_path, ColumnarExport::kVersion, ColumnarExport::kSectionsCount) {
+    if (!reader.IsValid()) {
+        error = reader.GetError();
+        return;
+    }
+
+    std::size_t values_count, changed_count, offsets_count, names_size;
+    const ValueType* values_data = reader.GetSection<ValueType>(ColumnarExport::kValues, values_count);
+    const int* changed_data = reader.GetSection<int>(ColumnarExport::kChangedCells, changed_count);
+    name_offsets = reader.GetSection<uint64_t>(ColumnarExport::kNameOffsets, offsets_count);
+    names = reader.GetSection<char>(ColumnarExport::kNames, names_size);
+
+    if (offsets_count != 0 && (offsets_count != values_count + 1 || name_offsets[0] != 0 || name_offsets[values_count] != names_size)) {
+        error = "Dictionary doesn't match values";
+        return;
+    }
+    for (std::size_t i = 0; i + 1 < offsets_count; i++) {
+        if (name_offsets[i] > name_offsets[i + 1]) {
+            error = "Dictionary doesn't match values";
+            return;
+        }
+    }
+    for (std::size_t i = 0; i < changed_count; i++) {
+        if (changed_data[i] < 0 || (std::size_t) changed_data[i] >= values_count) {
+            error = "Changed cell is out of range";
+            return;
+        }
+    }
+    values = Span<ValueType>(values_data, values_count);
+    changed_cells = Span<int>(changed_data, changed_count);
+    names_count = offsets_count == 0 ? 0 : values_count;
+    is_valid = true;
+}
@@ -0,0 +1,56 @@
+#ifndef SPREADSHEETENGINE_COLUMNAR_EXPORT_H
+#define SPREADSHEETENGINE_COLUMNAR_EXPORT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../io-data.h"
+#include "snapshot.h"
+
+// Binary columnar file of values for downstream tools. It uses the snapshot format (header with checksums,
+// 8-byte aligned arrays) with four sections: offsets of names, names, values by id and ids of changed cells.
+// The dictionary of names and the list of changed cells are empty if they are not exported,
+// so the dictionary can be exported once and later files contain only values.
+//
+// Values are written straight from the array and the reader maps the file, so there is no copying and
+// no allocations per cell on both sides.
+class ColumnarExport {
+public:
+    enum Section {
+        kNameOffsets, kNames, kValues, kChangedCells, kSectionsCount
+    };
+    static const uint32_t kVersion = 0x314c4f43; // "COL1" in little endian
+
+    static bool Write(const std::string& file_path, const std::vector<uint64_t>& name_offsets, const std::vector<char>& names,
+                      Span<ValueType> values, Span<int> changed_cells);
+};
+
+class ColumnarReader {
+public:
+    explicit ColumnarReader(const std::string& file_path);
+
+    bool IsValid() const { return is_valid; }
+    const std::string& GetError() const { return error; }
+
+    Span<ValueType> GetValues() const { return values; }
+    Span<int> GetChangedCells() const { return changed_cells; }
+    bool HasNames() const { return names_count > 0; }
+    // Requires HasNames().
+    std::string_view GetName(int id) const {
+        return std::string_view(names + name_offsets[id], name_offsets[id + 1] - name_offsets[id]);
+    }
+
+private:
+    SnapshotReader reader;
+    bool is_valid = false;
+    std::string error;
+
+    Span<ValueType> values;
+    Span<int> changed_cells;
+    const uint64_t* name_offsets = nullptr;
+    std::size_t names_count = 0;
+    const char* names = nullptr;
+};
+
+#endif //SPREADSHEETENGINE_COLUMNAR_EXPORT_H
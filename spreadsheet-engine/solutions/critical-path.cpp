@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <numeric>
+
+#include "critical-path.h"
+#include "../utils.h"
+
+// -------------- Cost model and ranks --------------
+
+double CriticalPathSolution::CellCost(int cell) const {
+    const auto& info = cells[cell];
+    return info.cost >= 0 ? info.cost : kAddendCostEstimate * info.formula.size();
+}
+
+// Goes through cells in reverse topological order, so ranks of all dependencies are already known.
+// Only cells of the current epoch are taken into account.
+void CriticalPathSolution::CalculateRanks(const std::vector<int>& top_sort) {
+    for (auto it = top_sort.rbegin(); it != top_sort.rend(); it++) {
+        auto& info = cells[*it];
+        double longest_path = 0;
+        for (const auto& next : info.dependencies) {
+            if (cells[next].epoch == epoch) {
+                longest_path = std::max(longest_path, cells[next].rank);
+            }
+        }
+        info.rank = CellCost(*it) + longest_path;
+    }
+}
+
+// Kahn's algorithm on cells of the current epoch.
+std::vector<int> CriticalPathSolution::TopSort(const std::vector<int>& cells_list) {
+    std::vector<int> order;
+    order.reserve(cells_list.size());
+    for (const auto& cell : cells_list) {
+        int cnt = 0;
+        for (const auto& it : cells[cell].formula) {
+            cnt += it.type == Addend::CELL && cells[it.value].epoch == epoch;
+        }
+        cells[cell].unresolved_cells_count.store(cnt, std::memory_order_relaxed);
+        if (cnt == 0) {
+            order.push_back(cell);
+        }
+    }
+
+    for (std::size_t i = 0; i < order.size(); i++) {
+        for (const auto& next : cells[order[i]].dependencies) {
+            auto& next_info = cells[next];
+            if (next_info.epoch == epoch && next_info.unresolved_cells_count.fetch_sub(1, std::memory_order_relaxed) == 1) {
+                order.push_back(next);
+            }
+        }
+    }
+    return order;
+}
+
+// -------------- Values calculation --------------
+
+void CriticalPathSolution::PushReadyCell(int cell) {
+    std::lock_guard<std::mutex> lock(ready_cells_mutex);
+    ready_cells.push({ cells[cell].rank, cell });
+}
+
+bool CriticalPathSolution::PopReadyCell(int& cell) {
+    std::lock_guard<std::mutex> lock(ready_cells_mutex);
+    if (ready_cells.empty()) {
+        return false;
+    }
+    cell = ready_cells.top().cell;
+    ready_cells.pop();
+    return true;
+}
+
+void CriticalPathSolution::CalculateCell(int cell) {
+    auto& info = cells[cell];
+
+    auto start = std::chrono::steady_clock::now();
+    SumType value = 0;
+    for (const auto& it : info.formula) {
+        value = sum(value, it.type == Addend::CELL ? cells[it.value].value : it.value);
+    }
+    info.value = SumValue(value);
+    double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    info.cost = info.cost < 0 ? elapsed : kCostSmoothing * elapsed + (1 - kCostSmoothing) * info.cost;
+
+    for (const auto& next : info.dependencies) {
+        auto& next_info = cells[next];
+        if (next_info.epoch == epoch && next_info.unresolved_cells_count.fetch_sub(1) == 1) {
+            PushReadyCell(next);
+        }
+    }
+    calculated_cells_count++;
+}
+
+void CriticalPathSolution::CalculateCellsThreadJob() {
+    int cell;
+    while (calculated_cells_count.load() < cells_to_calculate) {
+        if (PopReadyCell(cell)) {
+            CalculateCell(cell);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+// Calculates cells of the current epoch, 'top_sort' contains all of them in topological order.
+void CriticalPathSolution::CalculateCells(const std::vector<int>& top_sort) {
+    CalculateRanks(top_sort);
+
+    ready_cells = std::priority_queue<RankedCell>();
+    for (const auto& cell : top_sort) {
+        int cnt = 0;
+        for (const auto& it : cells[cell].formula) {
+            cnt += it.type == Addend::CELL && cells[it.value].epoch == epoch;
+        }
+        cells[cell].unresolved_cells_count.store(cnt);
+        if (cnt == 0) {
+            ready_cells.push({ cells[cell].rank, cell });
+        }
+    }
+
+#ifdef _DEBUG
+    double critical_path = 0;
+    for (const auto& cell : top_sort) {
+        critical_path = std::max(critical_path, cells[cell].rank);
+    }
+    std::cout << "        Critical path estimate: " << critical_path / 1e6 << " ms" << std::endl;
+#endif
+
+    cells_to_calculate = top_sort.size();
+    calculated_cells_count = 0;
+    if (top_sort.size() == 1) {
+        CalculateCell(top_sort[0]);
+        return;
+    }
+    runMultipleThreads([&]() { CalculateCellsThreadJob(); });
+}
+
+void CriticalPathSolution::InitialCalculate(const InputData& input_data) {
+    cells = std::vector<CellInfo>(input_data.size());
+    ids.Clear();
+    ids.Reserve(input_data.size());
+    for (const auto& it : input_data) {
+        cells[it.id].formula = it.formula;
+        ids.Insert(it.name, it.id);
+    }
+
+    epoch++;
+    for (std::size_t cell = 0; cell < cells.size(); cell++) {
+        cells[cell].epoch = epoch;
+        for (const auto& it : cells[cell].formula) {
+            if (it.type == Addend::CELL) {
+                cells[it.value].dependencies.push_back(cell);
+            }
+        }
+    }
+
+    std::vector<int> all_cells(cells.size());
+    std::iota(all_cells.begin(), all_cells.end(), 0);
+    CalculateCells(TopSort(all_cells));
+}
+
+// -------------- Change formula of a cell --------------
+
+void CriticalPathSolution::ChangeCell(const std::string& cell, const Formula& formula) {
+    int cell_id = ids.Find(cell);
+    if (!IsKnownEdit(cell_id, formula, cells.size())) {
+        return;
+    }
+    for (const auto& it : cells[cell_id].formula) {
+        if (it.type == Addend::CELL) {
+            auto& dependencies = cells[it.value].dependencies;
+            dependencies.erase(std::find(dependencies.begin(), dependencies.end(), cell_id));
+        }
+    }
+    cells[cell_id].formula = formula;
+    for (const auto& it : formula) {
+        if (it.type == Addend::CELL) {
+            cells[it.value].dependencies.push_back(cell_id);
+        }
+    }
+
+    // Mark all cells which are reachable from the changed one
+    epoch++;
+    std::vector<int> reachable = { cell_id };
+    cells[cell_id].epoch = epoch;
+    for (std::size_t i = 0; i < reachable.size(); i++) {
+        for (const auto& next : cells[reachable[i]].dependencies) {
+            if (cells[next].epoch != epoch) {
+                cells[next].epoch = epoch;
+                reachable.push_back(next);
+            }
+        }
+    }
+
+    CalculateCells(TopSort(reachable));
+}
+
+// -------------- Return current state of cells --------------
+
+OutputData CriticalPathSolution::GetCurrentValues() {
+    OutputData result = OutputData();
+    for (std::size_t cell = 0; cell < cells.size(); cell++) {
+        result[ids.GetName(cell)] = cells[cell].value;
+    }
+    return result;
+}
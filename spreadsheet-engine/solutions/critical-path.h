@@ -0,0 +1,85 @@
+#ifndef SPREADSHEETENGINE_CRITICAL_PATH_H
+#define SPREADSHEETENGINE_CRITICAL_PATH_H
+
+#include <atomic>
+#include <mutex>
+#include <queue>
+
+#include "solution.h"
+#include "../cell-ids.h"
+
+// Solution is designed for sheets where costs of cells vary a lot (expensive formulas are modelled by delay in sum()).
+// Cost of every cell is measured online: EWMA of evaluation time. Rank of a cell is the longest weighted path
+// from the cell to the end of the DAG (the cell cost is included). Ready cells are taken in order of rank
+// (critical path first, like HEFT list scheduling), so cells which gate large expensive subgraphs start first
+// and makespan approaches the critical path length.
+class CriticalPathSolution : public Solution {
+private:
+
+    // Weight of the last measurement in EWMA.
+    static constexpr double kCostSmoothing = 0.3;
+    // Cost estimate (in nanoseconds) of one addend for cells which were never calculated.
+    static constexpr double kAddendCostEstimate = 5.0;
+
+    struct CellInfo {
+        CellInfo() = default;
+        CellInfo(const CellInfo& other) : formula(other.formula) {}
+
+        Formula formula;
+        ValueType value = 0;
+        // Cells which contain this cell in formula.
+        std::vector<int> dependencies;
+
+        // Evaluation time in nanoseconds, -1 if the cell was never calculated.
+        double cost = -1;
+        double rank = 0;
+
+        std::atomic<int> unresolved_cells_count{0};
+        // Equals to 'epoch' if cell should be calculated by the current calculation.
+        int epoch = 0;
+    };
+
+    struct RankedCell {
+        double rank;
+        int cell;
+
+        bool operator<(const RankedCell& other) const {
+            return rank < other.rank;
+        }
+    };
+
+    std::vector<CellInfo> cells;
+    CellIds ids;
+    int epoch = 0;
+
+    // Ready cells, the cell with the highest rank is on top. Expensive cells dominate the time,
+    // so a heap under a mutex is good enough here.
+    std::priority_queue<RankedCell> ready_cells;
+    std::mutex ready_cells_mutex;
+
+    std::atomic<int> calculated_cells_count;
+    int cells_to_calculate = 0;
+
+    double CellCost(int cell) const;
+    void CalculateRanks(const std::vector<int>& top_sort);
+    std::vector<int> TopSort(const std::vector<int>& cells_list);
+
+    void PushReadyCell(int cell);
+    bool PopReadyCell(int& cell);
+    void CalculateCell(int cell);
+    void CalculateCellsThreadJob();
+    void CalculateCells(const std::vector<int>& top_sort);
+
+public:
+
+    // Time complexity is O(n log n) where n - number of vertices in input_data: ready cells are taken
+    // from a priority queue.
+    void InitialCalculate(const InputData& input_data) override;
+
+    // Time complexity is O(t log t) where t - total number of cells which are depended on 'cell'.
+    void ChangeCell(const std::string& cell, const Formula& formula) override;
+
+    OutputData GetCurrentValues() override;
+};
+
+#endif //SPREADSHEETENGINE_CRITICAL_PATH_H
@@ -0,0 +1,289 @@
+#include <cstring>
+#include <filesystem>
+
+#include "edit-log.h"
+#include "snapshot.h"
+#include "../mapped-file.h"
+
+#ifdef _WIN32
+  #include <io.h>
+  #include <fcntl.h>
+  #include <sys/stat.h>
+#else
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+// -------------- File operations --------------
+
+static int open_file(const std::string& file_path, bool append) {
+#ifdef _WIN32
+    return _open(file_path.c_str(), _O_RDWR | _O_CREAT | _O_BINARY | (append ? _O_APPEND : 0), _S_IREAD | _S_IWRITE);
+#else
+    return open(file_path.c_str(), O_RDWR | O_CREAT | (append ? O_APPEND : 0), 0644);
+#endif
+}
+
+static void close_file(int fd) {
+#ifdef _WIN32
+    _close(fd);
+#else
+    close(fd);
+#endif
+}
+
+static bool sync_file(int fd) {
+#ifdef _WIN32
+    return _commit(fd) == 0;
+#elif defined(__APPLE__)
+    return fsync(fd) == 0;
+#else
+    return fdatasync(fd) == 0;
+#endif
+}
+
+static bool truncate_file(int fd, std::size_t size) {
+#ifdef _WIN32
+    return _chsize_s(fd, size) == 0;
+#else
+    return ftruncate(fd, size) == 0;
+#endif
+}
+
+static bool sync_file(const std::string& file_path) {
+    int fd = open_file(file_path, false);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = sync_file(fd);
+    close_file(fd);
+    return ok;
+}
+
+// Rename is durable only after the directory is synced. Windows doesn't allow to open a directory this way.
+static bool sync_directory(const std::string& file_path) {
+#ifdef _WIN32
+    return true;
+#else
+    std::string directory = std::filesystem::path(file_path).parent_path().string();
+    int fd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+#endif
+}
+
+// -------------- Records --------------
+
+// Record is payload size and checksum of payload (uint32), then payload:
+// name size (uint32), name, addends count (uint32), addends as pairs (type, value) of int32.
+// A deletion of the cell has kDeletion in place of the addends count and no addends.
+static const uint32_t kDeletion = UINT32_MAX;
+
+static void add_uint32(std::string& data, uint32_t x) {
+    data.append((const char*) &x, sizeof(x));
+}
+
+static uint32_t read_uint32(const char* p) {
+    uint32_t x;
+    std::memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+static void append_record(std::string& buffer, const std::string& cell, const Formula* formula) {
+    std::string payload;
+    std::size_t addends_count = formula != nullptr ? formula->size() : 0;
+    payload.reserve(2 * sizeof(uint32_t) + cell.size() + addends_count * 2 * sizeof(int32_t));
+    add_uint32(payload, cell.size());
+    payload += cell;
+    add_uint32(payload, formula != nullptr ? (uint32_t) addends_count : kDeletion);
+    for (std::size_t i = 0; i < addends_count; i++) {
+        add_uint32(payload, (uint32_t) (*formula)[i].type);
+        add_uint32(payload, (uint32_t) (*formula)[i].value);
+    }
+    add_uint32(buffer, payload.size());
+    add_uint32(buffer, (uint32_t) snapshot_checksum(payload.data(), payload.size()));
+    buffer += payload;
+}
+
+// Parses records from the beginning of the log until the first damaged one. Returns size of the valid part.
+// 'edit' gets the edit and true for deletions.
+static std::size_t parse_records(const char* data, std::size_t size,
+                                 const std::function<void(InputCellInfo&&, bool)>* edit) {
+    std::size_t position = 0;
+    while (size - position >= 2 * sizeof(uint32_t)) {
+        const char* record = data + position;
+        std::size_t payload_size = read_uint32(record);
+        const char* payload = record + 2 * sizeof(uint32_t);
+        if (payload_size > size - position - 2 * sizeof(uint32_t) || payload_size < 2 * sizeof(uint32_t) ||
+            read_uint32(record + sizeof(uint32_t)) != (uint32_t) snapshot_checksum(payload, payload_size)) {
+            break;
+        }
+
+        std::size_t name_size = read_uint32(payload);
+        if (name_size > payload_size - 2 * sizeof(uint32_t)) {
+            break;
+        }
+        uint32_t addends_count = read_uint32(payload + sizeof(uint32_t) + name_size);
+        bool is_deletion = addends_count == kDeletion;
+        std::size_t addends_size = is_deletion ? 0 : (std::size_t) addends_count * 2 * sizeof(int32_t);
+        if (addends_size != payload_size - 2 * sizeof(uint32_t) - name_size) {
+            break;
+        }
+
+        if (edit != nullptr) {
+            InputCellInfo cell;
+            cell.id = -1;
+            cell.name.assign(payload + sizeof(uint32_t), name_size);
+            const char* addends = payload + 2 * sizeof(uint32_t) + name_size;
+            cell.formula.resize(is_deletion ? 0 : addends_count);
+            for (std::size_t i = 0; i < cell.formula.size(); i++) {
+                cell.formula[i] = Addend((Addend::Type) read_uint32(addends + 8 * i), (int) read_uint32(addends + 8 * i + 4));
+            }
+            (*edit)(std::move(cell), is_deletion);
+        }
+        position += 2 * sizeof(uint32_t) + payload_size;
+    }
+    return position;
+}
+
+void EditLog::ReadEdits(const std::string& file_path, const std::function<void(const InputData&)>& change,
+                        const std::function<void(const std::string&)>& remove) {
+    MappedFile file(file_path);
+    if (!file.IsOpen()) {
+        return;
+    }
+    InputData changes;
+    std::function<void(InputCellInfo&&, bool)> edit = [&](InputCellInfo&& cell, bool is_deletion) {
+        if (!is_deletion) {
+            changes.push_back(std::move(cell));
+            return;
+        }
+        if (!changes.empty()) {
+            change(changes);
+            changes.clear();
+        }
+        remove(cell.name);
+    };
+    parse_records(file.Data(), file.Size(), &edit);
+    if (!changes.empty()) {
+        change(changes);
+    }
+}
+
+// -------------- Log --------------
+
+EditLog::EditLog(const std::string& file_path) {
+    std::size_t valid_size = 0;
+    {
+        MappedFile file(file_path);
+        if (file.IsOpen()) {
+            valid_size = parse_records(file.Data(), file.Size(), nullptr);
+        }
+    }
+
+    fd = open_file(file_path, true);
+    if (fd < 0) {
+        return;
+    }
+    if (!truncate_file(fd, valid_size)) {
+        close_file(fd);
+        fd = -1;
+        return;
+    }
+    writer = std::thread([&]() { Run(); });
+}
+
+EditLog::~EditLog() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopped = true;
+    }
+    has_records.notify_one();
+    if (writer.joinable()) {
+        writer.join();
+    }
+    if (fd >= 0) {
+        close_file(fd);
+    }
+}
+
+uint64_t EditLog::Append(const std::string& cell, const Formula& formula) {
+    std::string record;
+    append_record(record, cell, &formula);
+    return AppendRecord(record);
+}
+
+uint64_t EditLog::AppendDeletion(const std::string& cell) {
+    std::string record;
+    append_record(record, cell, nullptr);
+    return AppendRecord(record);
+}
+
+uint64_t EditLog::AppendRecord(const std::string& record) {
+    std::lock_guard<std::mutex> lock(mutex);
+    buffer += record;
+    has_records.notify_one();
+    return ++appended_sequence;
+}
+
+bool EditLog::WaitDurable(uint64_t sequence) {
+    if (!IsOpen()) {
+        return false;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    is_durable.wait(lock, [&]() { return durable_sequence >= sequence || is_failed; });
+    return !is_failed;
+}
+
+// One write and one fsync for all records which are in the buffer, both are done by 'io'.
+void EditLog::Run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        has_records.wait(lock, [&]() { return !buffer.empty() || stopped; });
+        if (buffer.empty()) {
+            return;
+        }
+
+        std::string data;
+        data.swap(buffer);
+        uint64_t sequence = appended_sequence;
+        lock.unlock();
+        bool ok = io.Wait(io.Write(fd, AsyncFileIO::kAppend, { { data.data(), data.size() } }, true));
+        lock.lock();
+
+        is_failed = is_failed || !ok;
+        durable_sequence = sequence;
+        is_durable.notify_all();
+    }
+}
+
+bool EditLog::Checkpoint(const std::string& checkpoint_path, const std::function<bool(const std::string&)>& save) {
+    uint64_t sequence;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sequence = appended_sequence;
+    }
+    // After that the writer is idle, so the log can be truncated.
+    if (!WaitDurable(sequence)) {
+        return false;
+    }
+
+    std::string temporary_path = checkpoint_path + ".tmp";
+    if (!save(temporary_path) || !sync_file(temporary_path)) {
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary_path, checkpoint_path, error);
+    if (error || !sync_directory(checkpoint_path)) {
+        return false;
+    }
+
+    // Edit sets the formula and a deletion of an unknown cell is ignored, so records which are already
+    // in the checkpoint can be replayed again and a crash before the truncation is safe.
+    std::lock_guard<std::mutex> lock(mutex);
+    return truncate_file(fd, 0) && sync_file(fd);
+}
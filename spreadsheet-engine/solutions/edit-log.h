@@ -0,0 +1,69 @@
+#ifndef SPREADSHEETENGINE_EDIT_LOG_H
+#define SPREADSHEETENGINE_EDIT_LOG_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "../async-file-io.h"
+#include "../io-data.h"
+
+// Append-only log of ChangeCell edits and DeleteCell calls (write-ahead log). A record is a cell name and a formula
+// (or a deletion mark) protected by a checksum. AddCell is logged as an edit, since ChangeCell of an unknown cell adds it.
+//
+// Group commit: Append() only adds the record to the buffer. One thread writes the whole buffer and calls fsync,
+// so all edits which were appended during the previous fsync share the next one. The write and fsync go through
+// AsyncFileIO, so on Linux they are io_uring operations.
+// Checkpoint() saves the state and truncates the log. Recovery loads the checkpoint and replays ReadEdits().
+class EditLog {
+public:
+    // Opens or creates the log. A damaged record at the end (crash in the middle of a write) is cut off.
+    explicit EditLog(const std::string& file_path);
+    ~EditLog();
+
+    EditLog(const EditLog&) = delete;
+    EditLog& operator=(const EditLog&) = delete;
+
+    bool IsOpen() const { return fd >= 0; }
+
+    // Adds the edit to the log and returns its sequence number. Doesn't wait for the disk.
+    uint64_t Append(const std::string& cell, const Formula& formula);
+    // The same for a deletion of the cell.
+    uint64_t AppendDeletion(const std::string& cell);
+
+    // Waits until the edit with the sequence number and all edits before it are on disk.
+    // Returns false if the log can't be written.
+    bool WaitDurable(uint64_t sequence);
+
+    // 'save' writes the state which contains all appended edits to the given file. The file replaces 'checkpoint_path'
+    // atomically, then the log is truncated. Append() should not be called until Checkpoint() returns.
+    bool Checkpoint(const std::string& checkpoint_path, const std::function<bool(const std::string&)>& save);
+
+    // Edits of the log in order of appending: consecutive edits are given to 'change' as one batch (for ChangeCells),
+    // deletions are given to 'remove' between them. Cell ids of formulas are ids of the solution which wrote them,
+    // they are the same after replay because deleted ids are reused in the same order.
+    static void ReadEdits(const std::string& file_path, const std::function<void(const InputData&)>& change,
+                          const std::function<void(const std::string&)>& remove);
+
+private:
+    int fd = -1;
+
+    std::mutex mutex;
+    std::condition_variable has_records;
+    std::condition_variable is_durable;
+    std::string buffer;
+    uint64_t appended_sequence = 0;
+    uint64_t durable_sequence = 0;
+    bool is_failed = false;
+    bool stopped = false;
+    AsyncFileIO io;
+    std::thread writer;
+
+    uint64_t AppendRecord(const std::string& record);
+    void Run();
+};
+
+#endif //SPREADSHEETENGINE_EDIT_LOG_H
@@ -0,0 +1,64 @@
+#include <vector>
+
+#include "external-service.h"
+#include "solution.h"
+
+ExternalService::ExternalService(std::chrono::microseconds latency) : latency(latency) {
+    worker = std::thread([this]() { Run(); });
+}
+
+ExternalService::~ExternalService() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopped = true;
+    }
+    condition.notify_one();
+    worker.join();
+}
+
+void ExternalService::Sum(SumType a, ValueType b, Callback callback) {
+    if (latency.count() == 0) {
+        callback(sum(a, b));
+        return;
+    }
+
+    bool was_empty;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        was_empty = requests.empty();
+        requests.push_back({ clock_::now() + latency, sum(a, b), std::move(callback) });
+    }
+    if (was_empty) {
+        condition.notify_one();
+    }
+}
+
+void ExternalService::Run() {
+    std::vector<Request> answered;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        condition.wait(lock, [&]() { return stopped || !requests.empty(); });
+        if (stopped) {
+            return;
+        }
+
+        auto deadline = requests.front().deadline;
+        if (clock_::now() < deadline) {
+            condition.wait_until(lock, deadline);
+            continue;
+        }
+
+        // Answer all requests which are ready, callbacks are called without the lock.
+        auto now = clock_::now();
+        while (!requests.empty() && requests.front().deadline <= now) {
+            answered.push_back(std::move(requests.front()));
+            requests.pop_front();
+        }
+        lock.unlock();
+        for (auto& it : answered) {
+            it.callback(it.result);
+        }
+        answered.clear();
+        lock.lock();
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef SPREADSHEETENGINE_EXTERNAL_SERVICE_H
+#define SPREADSHEETENGINE_EXTERNAL_SERVICE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "solution.h"
+
+// Local stand-in for a slow backend which evaluates formula functions.
+// Every call is answered after 'latency', the callback is called from the service thread.
+// One thread serves all calls in flight, so thousands of calls can overlap.
+class ExternalService {
+public:
+    using Callback = std::function<void(SumType)>;
+
+    explicit ExternalService(std::chrono::microseconds latency);
+    ~ExternalService();
+
+    // Result is sum(a, b), a partial sum of a formula. With zero latency the callback is called immediately
+    // from the current thread.
+    void Sum(SumType a, ValueType b, Callback callback);
+
+private:
+    typedef std::chrono::steady_clock clock_;
+
+    struct Request {
+        std::chrono::time_point<clock_> deadline;
+        SumType result;
+        Callback callback;
+    };
+
+    std::chrono::microseconds latency;
+
+    // Latency is constant, so requests are sorted by deadline.
+    std::deque<Request> requests;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopped = false;
+    std::thread worker;
+
+    void Run();
+};
+
+#endif //SPREADSHEETENGINE_EXTERNAL_SERVICE_H
@@ -2,65 +2,127 @@
 #include <execution>
 #include <cassert>
 #include <functional>
+#include <numeric>
+#include <type_traits>
 #include <unordered_set>
 
 #include "fast.h"
+#include "../radix-sort.h"
 #include "../utils.h"
+#include "../writer.h"
+#include "columnar-export.h"
+
+#ifdef _MSC_VER
+  #include <intrin.h>
+#endif
+
+#ifndef _WIN32
+  #include <cerrno>
+  #include <fcntl.h>
+  #include <sys/wait.h>
+  #include <unistd.h>
+#endif
 
 
 // -------------- Common methods--------------
 
+inline void prefetch(const void* p) {
+#ifdef _MSC_VER
+    _mm_prefetch((const char*) p, _MM_HINT_T0);
+#else
+    __builtin_prefetch(p);
+#endif
+}
+
+inline ValueType FastSolution::GetAddendValue(const Addend& addend) const {
+    return addend.type == Addend::CELL ? cell_info[addend.value]->value.load(std::memory_order_acquire).value : addend.value;
+}
+
+// Precedents of a cell are scattered over the heap. In wide formulas all of them are prefetched first, so their
+// cache misses overlap, then they are loaded 4 at a time without a branch per addend. Values of precedents are
+// published before their dependents are evaluated, so acquire loads are enough.
 inline ValueType FastSolution::CalculateCellValue(int cell, const Formula& formula) {
-    ValueType value = 0;
-    for (const auto& it : formula) {
-        switch (it.type) {
-            case Addend::CELL: {
-                int addend_cell = it.value;
-                auto addend = cell_info[addend_cell]->value.load();
-                value = sum(value, addend.value);
-                break;
-            }
+    if (memo_cache) {
+        return CalculateCellValueWithMemoization(formula);
+    }
 
-            case Addend::VALUE: {
-                ValueType addend = it.value;
-                value = sum(value, addend);
-                break;
+    const Addend* addends = formula.data();
+    std::size_t size = formula.size();
+    if (size >= kMinPrefetchFormulaSize) {
+        for (std::size_t i = 0; i < size; i++) {
+            if (addends[i].type == Addend::CELL) {
+                prefetch(&cell_info[addends[i].value]->value);
             }
-
-            default:
-                assert(false);
         }
     }
-    return value;
+    SumType value = 0;
+    std::size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        ValueType a0 = GetAddendValue(addends[i]);
+        ValueType a1 = GetAddendValue(addends[i + 1]);
+        ValueType a2 = GetAddendValue(addends[i + 2]);
+        ValueType a3 = GetAddendValue(addends[i + 3]);
+        value = sum(sum(sum(sum(value, a0), a1), a2), a3);
+    }
+    for (; i < size; i++) {
+        value = sum(value, GetAddendValue(addends[i]));
+    }
+    return SumValue(value);
 }
 
-inline void runMultipleThreads(const std::function<void()>& function) {
-    int threads_count = get_threads_count();
+ValueType FastSolution::CalculateCellValueWithMemoization(const Formula& formula) {
+    MemoCache::KeyBuilder key_builder;
+    for (const auto& it : formula) {
+        if (it.type == Addend::CELL) {
+            key_builder.AddCell(it.value, cell_info[it.value]->value.load().value);
+        } else {
+            key_builder.AddValue(it.value);
+        }
+    }
 
-    std::vector<std::thread> threads;
-    for (int i = 0; i < threads_count; i++) {
-        threads.push_back(std::thread(function));
+    MemoCache::Key key = key_builder.GetKey();
+    ValueType value = 0;
+    if (memo_cache->Find(key, value)) {
+        return value;
     }
 
-    for (int i = 0; i < threads_count; i++) {
-        threads[i].join();
+    SumType formula_sum = 0;
+    for (const auto& it : formula) {
+        ValueType addend = it.type == Addend::CELL ? cell_info[it.value]->value.load().value : it.value;
+        formula_sum = sum(formula_sum, addend);
     }
+    value = SumValue(formula_sum);
+    memo_cache->Insert(key, value);
+    return value;
+}
+
+void FastSolution::EnableMemoization(std::size_t capacity) {
+    memo_cache.reset(new MemoCache(capacity));
 }
 
 // -------------- DAG building --------------
 
-void FastSolution::BuildDAG(bool parallel, const InputData& input_data) {
+template <typename Input>
+void FastSolution::BuildDAG(bool parallel, Input& input_data) {
 
-    auto add_edges = [&](const InputCellInfo& cell_info_io) {
+    auto add_edges = [&](auto& cell_info_io) {
         
-        CellInfo* info = new CellInfo(cell_info_io.formula, cell_info_io.name);
+        CellInfo* info;
+        if constexpr (std::is_const_v<Input>) {
+            info = new CellInfo(cell_info_io.formula);
+        } else {
+            info = new CellInfo(std::move(cell_info_io.formula));
+        }
         int cell = cell_info_io.id;
 
         cell_info[cell] = info;
-        id_by_name[cell_info_io.name] = cell;
+        // Names of the input are unique, AppendCells() checks them before the DAG is changed.
+        bool is_inserted = ids.Insert(cell_info_io.name, cell);
+        assert(is_inserted);
+        (void) is_inserted;
 
         bool just_value = true;
-        for (const auto& formula_it : cell_info_io.formula) {
+        for (const auto& formula_it : info->formula) {
             if (formula_it.type == Addend::CELL) {
                 int next = formula_it.value;
                 DAG[next].push_back(OptionalCell(cell, false));
@@ -73,7 +135,7 @@ void FastSolution::BuildDAG(bool parallel, const InputData& input_data) {
         }
     };
 
-    auto lambda = [&](InputCellInfo it) { add_edges(it); };
+    auto lambda = [&](auto& it) { add_edges(it); };
 
     if (parallel) {
         std::for_each(std::execution::par_unseq, std::begin(input_data), std::end(input_data), lambda);
@@ -90,17 +152,80 @@ void FastSolution::ParallelBuildDAG(const InputData& input_data) {
     BuildDAG(true, input_data);
 }
 
+// -------------- Chain contraction --------------
+
+void FastSolution::UpdateChainLink(int cell) {
+    int next = -1;
+    int edges_count = 0;
+    for (const auto& it : DAG[cell]) {
+        if (!it.is_deleted) {
+            next = it.cell;
+            edges_count++;
+        }
+    }
+
+    chain_next[cell] = -1;
+    if (edges_count != 1) {
+        return;
+    }
+
+    int references_count = 0;
+    for (const auto& it : cell_info[next]->formula) {
+        references_count += it.type == Addend::CELL;
+    }
+    if (references_count == 1) {
+        chain_next[cell] = next;
+    }
+}
+
+// Edges are not removed by edits, they are marked as deleted. Edges of a cell whose dependents are edited
+// or deleted many times are rebuilt without deleted ones, so their memory doesn't grow without bound.
+void FastSolution::CompactEdges(int cell) {
+    Edges& edges = DAG[cell];
+    std::size_t deleted_count = std::count_if(edges.begin(), edges.end(), [](const OptionalCell& it) { return it.is_deleted; });
+    if (deleted_count < kMinCompactedEdges || deleted_count * 2 < edges.size()) {
+        return;
+    }
+    Edges live_edges;
+    for (const auto& it : edges) {
+        if (!it.is_deleted) {
+            live_edges.push_back(it);
+        }
+    }
+    edges.swap(live_edges);
+}
+
+// Evaluates cells of the chain which starts from already evaluated 'cell'. Returns the last cell of the chain.
+// Only the thread which evaluated the head can reach the chain cells, so we don't need any synchronization here.
+int FastSolution::EvaluateChainTail(int cell) {
+    int evaluated = 0;
+    for (int next = chain_next[cell]; next != -1; next = chain_next[cell]) {
+        cell = next;
+        auto& info = cell_info[cell];
+        info->value.store(CellValue(true, CalculateCellValue(cell, info->formula)), std::memory_order_release);
+        evaluated++;
+    }
+    if (evaluated > 0) {
+        calculated_cells_count.fetch_add(evaluated);
+    }
+    return cell;
+}
+
 // -------------- Initial values calculation --------------
 
 void FastSolution::InitialValuesCalculationThreadJob() {
     int cells_count = cell_info.size();
     int cell;
 
+    // One of the cells which become ready after current task is evaluated by the same thread, so small subtrees
+    // don't go through the queue.
+    bool has_continuation = false;
+
     while (calculated_cells_count.load(std::memory_order_acquire) < cells_count) {
-        bool success = lock_free_queue.try_dequeue(cell);
-        if (!success) {
+        if (!has_continuation && !lock_free_queue.try_dequeue(cell)) {
             continue;
         }
+        has_continuation = false;
 
         auto& c_info = cell_info[cell];
 
@@ -120,15 +245,21 @@ void FastSolution::InitialValuesCalculationThreadJob() {
         }   
         
         calculated_cells_count.fetch_add(1);
+        int tail = EvaluateChainTail(cell);
 
-        for (const auto& it : DAG[cell]) {
+        for (const auto& it : DAG[tail]) {
             int next = it.cell;
             const auto& next_info = cell_info.at(next);
                 
             if (!next_info->value.load().is_calculated) {
                 int unresolved_count = next_info->unresolved_cells_count.fetch_sub(1) - 1;
                 if (unresolved_count == 0) {
-                    lock_free_queue.enqueue(next);
+                    if (has_continuation) {
+                        lock_free_queue.enqueue(next);
+                    } else {
+                        cell = next;
+                        has_continuation = true;
+                    }
                 }
             }
         }
@@ -156,33 +287,538 @@ void FastSolution::ParallelValuesCalculation() {
 }
 
 void FastSolution::InitialCalculate(const InputData& input_data) {
+    Initialize(input_data);
+    CalculateInitialValues();
+}
+
+void FastSolution::InitialCalculate(InputData&& input_data) {
+    {
+        InputData owned_input = std::move(input_data);
+        Initialize(owned_input);
+    }
+    CalculateInitialValues();
+}
+
+template <typename Input>
+void FastSolution::Initialize(Input& input_data) {
 
     // Data initialization
+    fork_base.reset();
+    FreeCells();
     std::for_each(std::execution::par_unseq, std::begin(DAG), std::end(DAG), [](Edges& e) { e.clear(); });
     DAG.resize(input_data.size());
     cell_info.resize(input_data.size());
+    ids.Clear();
+    ids.Reserve(input_data.size());
+    ResetOutputOrder();
+    free_cells.clear();
+    ResetJournal();
     starting_cells.clear();
     calculated_cells_count = 0;
+    plans.clear();
+    edit_count.clear();
 
     {
 #ifdef _DEBUG
         Timer timer("        Parallel building DAG time: ");
 #endif
-        ParallelBuildDAG(input_data);
+        BuildDAG(true, input_data);
+        chain_next.resize(input_data.size());
+        std::for_each(std::execution::par_unseq, std::begin(input_data), std::end(input_data), 
+            [&](const InputCellInfo& it) { UpdateChainLink(it.id); });
     }
+}
+
+void FastSolution::FreeCells() {
+    published_count.store(0, std::memory_order_release);
+    for (auto& it : cell_info) {
+        delete it;
+        it = nullptr;
+    }
+}
 
+void FastSolution::CalculateInitialValues() {
     {
 #ifdef _DEBUG
         Timer timer("        Parallel values calculation time: ");
 #endif
         ParallelValuesCalculation();
     }
+
+    PublishCells(0, cell_info.size());
+    RebuildExports();
+}
+
+// -------------- Streaming load --------------
+
+// Every cell has one extra unresolved dependency until it is loaded, so it can't be evaluated before.
+// Edge 'a' -> 'b' is added and 'a' is marked as evaluated under the mutex of 'a'. Edges which were added before 'a'
+// was evaluated are resolved by the thread which evaluated 'a', the rest of them are resolved already.
+void FastSolution::BeginLoad(int cells_count) {
+    AbortLoad();
+    fork_base.reset();
+    FreeCells();
+
+    std::for_each(std::execution::par_unseq, std::begin(DAG), std::end(DAG), [](Edges& e) { e.clear(); });
+    DAG.resize(cells_count);
+    cell_info.resize(cells_count);
+    std::for_each(std::execution::par_unseq, std::begin(cell_info), std::end(cell_info), [](CellInfo*& info) {
+        info = new CellInfo(Formula());
+        info->unresolved_cells_count = 1;
+    });
+    ids.Clear();
+    ids.Reserve(cells_count);
+    ResetOutputOrder();
+    free_cells.clear();
+    ResetJournal();
+    chain_next.assign(cells_count, -1);
+    starting_cells.clear();
+    calculated_cells_count = 0;
+    plans.clear();
+    edit_count.clear();
+
+    lock_free_queue = moodycamel::BlockingConcurrentQueue<int>(cells_count);
+    is_load_aborted = false;
+    for (unsigned int i = 0; i < get_threads_count(); i++) {
+        load_threads.emplace_back([&]() { StreamingCalculationThreadJob(); });
+    }
+}
+
+void FastSolution::LoadCell(InputCellInfo& cell_info_io) {
+    int cell = cell_info_io.id;
+    CellInfo* info = cell_info[cell];
+    info->formula = std::move(cell_info_io.formula);
+    ids.Insert(cell_info_io.name, cell);
+
+    for (const auto& formula_it : info->formula) {
+        if (formula_it.type == Addend::CELL) {
+            int previous = formula_it.value;
+            std::lock_guard<std::mutex> lock(cell_info[previous]->mutex);
+            if (!cell_info[previous]->value.load().is_calculated) {
+                info->unresolved_cells_count++;
+            }
+            DAG[previous].push_back(OptionalCell(cell, false));
+        }
+    }
+
+    if (info->unresolved_cells_count.fetch_sub(1) == 1) {
+        lock_free_queue.enqueue(cell);
+    }
+}
+
+void FastSolution::StreamingCalculationThreadJob() {
+    int cells_count = cell_info.size();
+    int cell;
+    bool has_continuation = false;
+
+    while (calculated_cells_count.load(std::memory_order_acquire) < cells_count) {
+        // Parser is still working, so threads wait instead of spinning.
+        if (!has_continuation && !lock_free_queue.wait_dequeue_timed(cell, std::chrono::milliseconds(1))) {
+            if (is_load_aborted) {
+                return;
+            }
+            continue;
+        }
+        has_continuation = false;
+
+        auto& c_info = cell_info[cell];
+        ValueType value = CalculateCellValue(cell, c_info->formula);
+        std::size_t edges_count;
+        {
+            std::lock_guard<std::mutex> lock(c_info->mutex);
+            c_info->value.store(CellValue(true, value));
+            edges_count = DAG[cell].size();
+        }
+        calculated_cells_count.fetch_add(1);
+
+        const auto& edges = DAG[cell];
+        for (std::size_t i = 0; i < edges_count; i++) {
+            int next = edges[i].cell;
+            if (cell_info[next]->unresolved_cells_count.fetch_sub(1) == 1) {
+                if (has_continuation) {
+                    lock_free_queue.enqueue(next);
+                } else {
+                    cell = next;
+                    has_continuation = true;
+                }
+            }
+        }
+    }
+}
+
+void FastSolution::EndLoad() {
+    for (auto& it : load_threads) {
+        it.join();
+    }
+    load_threads.clear();
+    fork_base.reset();
+
+    std::vector<int> cells(cell_info.size());
+    std::iota(cells.begin(), cells.end(), 0);
+    std::for_each(std::execution::par_unseq, std::begin(cells), std::end(cells), [&](int cell) { UpdateChainLink(cell); });
+
+#ifdef _DEBUG
+    if (cell_info.size() != calculated_cells_count.load()) {
+        std::cout << std::endl << "FAIL!!! [EndLoad] calculated_cells_count is wrong" << std::endl;
+        exit(1);
+    }
+#endif
+    PublishCells(0, cell_info.size());
+    RebuildExports();
+}
+
+// Stops threads of unfinished load, e.g. if the parser failed.
+void FastSolution::AbortLoad() {
+    is_load_aborted = true;
+    for (auto& it : load_threads) {
+        it.join();
+    }
+    load_threads.clear();
+}
+
+// -------------- Snapshot --------------
+
+void FastSolution::BuildSnapshot(SnapshotData& data, bool parallel) {
+    auto for_each_cell = [&](const std::vector<int>& cells, const std::function<void(int)>& function) {
+        if (parallel) {
+            std::for_each(std::execution::par_unseq, cells.begin(), cells.end(), function);
+        } else {
+            std::for_each(std::execution::seq, cells.begin(), cells.end(), function);
+        }
+    };
+
+    std::size_t cells_count = cell_info.size();
+    std::vector<int> cells(cells_count);
+    std::iota(cells.begin(), cells.end(), 0);
+
+    data.formula_offsets.assign(cells_count + 1, 0);
+    data.dependent_offsets.assign(cells_count + 1, 0);
+    data.name_offsets.assign(cells_count + 1, 0);
+    // Deleted cells are kept with empty names, so ids don't change.
+    for_each_cell(cells, [&](int cell) {
+        data.formula_offsets[cell + 1] = cell_info[cell] != nullptr ? cell_info[cell]->formula.size() : 0;
+        for (const auto& it : DAG[cell]) {
+            data.dependent_offsets[cell + 1] += !it.is_deleted;
+        }
+        data.name_offsets[cell + 1] = ids.GetName(cell).size();
+    });
+    std::partial_sum(data.formula_offsets.begin(), data.formula_offsets.end(), data.formula_offsets.begin());
+    std::partial_sum(data.dependent_offsets.begin(), data.dependent_offsets.end(), data.dependent_offsets.begin());
+    std::partial_sum(data.name_offsets.begin(), data.name_offsets.end(), data.name_offsets.begin());
+
+    // Addend is a pair (type, value) of 32-bit integers.
+    data.addends.assign(2 * data.formula_offsets[cells_count], 0);
+    data.dependents.assign(data.dependent_offsets[cells_count], 0);
+    data.names.assign(data.name_offsets[cells_count], 0);
+    data.values.assign(cells_count, 0);
+    data.chain_next.assign(chain_next.begin(), chain_next.end());
+    for_each_cell(cells, [&](int cell) {
+        uint64_t addend = data.formula_offsets[cell];
+        for (uint64_t i = 0; i < data.formula_offsets[cell + 1] - data.formula_offsets[cell]; i++) {
+            const auto& it = cell_info[cell]->formula[i];
+            data.addends[2 * addend] = it.type;
+            data.addends[2 * addend + 1] = it.value;
+            addend++;
+        }
+        uint64_t dependent = data.dependent_offsets[cell];
+        for (const auto& it : DAG[cell]) {
+            if (!it.is_deleted) {
+                data.dependents[dependent++] = it.cell;
+            }
+        }
+        std::string name = ids.GetName(cell);
+        std::copy(name.begin(), name.end(), data.names.begin() + data.name_offsets[cell]);
+        data.values[cell] = GetCellValue(cell);
+    });
+}
+
+// Sections are added in order of SnapshotSection.
+void FastSolution::AddSnapshotSections(SnapshotWriter& writer, const SnapshotData& data) {
+    writer.AddSection(data.formula_offsets);
+    writer.AddSection(data.addends);
+    writer.AddSection(data.dependent_offsets);
+    writer.AddSection(data.dependents);
+    writer.AddSection(data.name_offsets);
+    writer.AddSection(data.names);
+    writer.AddSection(data.values);
+    writer.AddSection(data.chain_next);
+}
+
+bool FastSolution::WriteSnapshot(const SnapshotData& data, const std::string& file_path, bool parallel) {
+    SnapshotWriter writer(kSnapshotVersion);
+    AddSnapshotSections(writer, data);
+    return writer.Write(file_path, parallel);
+}
+
+bool FastSolution::SaveSnapshot(const std::string& file_path) {
+    SnapshotData data;
+    BuildSnapshot(data, true);
+    return WriteSnapshot(data, file_path, true);
+}
+
+// Arrays of the snapshot are owned by the request, so the state can change while the file is written.
+void FastSolution::SaveSnapshotAsync(const std::string& file_path) {
+    auto data = std::make_shared<SnapshotData>();
+    BuildSnapshot(*data, true);
+    SnapshotWriter writer(kSnapshotVersion);
+    AddSnapshotSections(writer, *data);
+    writer.WriteAsync(file_path, GetAsyncIO(), data);
+}
+
+#ifdef _WIN32
+
+// There is no fork() on Windows: the state is copied to snapshot arrays now, the file is written by another thread.
+bool FastSolution::StartBackgroundSnapshot(const std::string& file_path) {
+    if (background_snapshot.valid()) {
+        return false;
+    }
+    auto data = std::make_shared<SnapshotData>();
+    BuildSnapshot(*data, true);
+    background_snapshot = std::async(std::launch::async, [data, file_path]() { return WriteSnapshot(*data, file_path, true); });
+    return true;
+}
+
+bool FastSolution::WaitBackgroundSnapshot() {
+    return background_snapshot.valid() && background_snapshot.get();
+}
+
+#else
+
+// The child process gets a copy-on-write image of the memory, so it sees the state frozen at the moment of fork()
+// and the parent continues at once. Only the forking thread exists in the child, and locks which other threads
+// (TBB workers, I/O threads, readers) held at fork() stay locked there. So the snapshot is taken only when the solution
+// is quiesced: no load threads run and this thread, the only writer, is between edits. The child doesn't use TBB,
+// streams or locks of the solution: cells are read sequentially and the file, which is opened by the parent, is written
+// by write() calls. Memory is allocated by malloc, which is safe after fork() in glibc and on macOS.
+bool FastSolution::StartBackgroundSnapshot(const std::string& file_path) {
+    if (background_snapshot != -1 || !load_threads.empty()) {
+        return false;
+    }
+    int fd = open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fd);
+        return false;
+    }
+    if (pid == 0) {
+        // Serving edits is more important than the snapshot. nice() returns -1 and sets errno if the priority
+        // can't be lowered (e.g. by a resource limit): the snapshot is written at the normal priority then,
+        // the exit status tells it.
+        errno = 0;
+        bool is_niced = nice(10) != -1 || errno == 0;
+        SnapshotData data;
+        BuildSnapshot(data, false);
+        SnapshotWriter writer(kSnapshotVersion);
+        AddSnapshotSections(writer, data);
+        _exit(!writer.Write(fd, false) ? 1 : is_niced ? 0 : 2);
+    }
+    close(fd);
+    background_snapshot = pid;
+    return true;
+}
+
+bool FastSolution::WaitBackgroundSnapshot() {
+    if (background_snapshot == -1) {
+        return false;
+    }
+    int status;
+    pid_t pid = waitpid(background_snapshot, &status, 0);
+    background_snapshot = -1;
+    // 2 means that the snapshot was written at the normal priority.
+    return pid != -1 && WIFEXITED(status) && (WEXITSTATUS(status) == 0 || WEXITSTATUS(status) == 2);
+}
+
+#endif
+
+bool FastSolution::LoadSnapshot(const std::string& file_path, std::string& error) {
+    SnapshotReader reader(file_path, kSnapshotVersion, kSnapshotSectionsCount);
+    if (!reader.IsValid()) {
+        error = reader.GetError();
+        return false;
+    }
+
+    std::size_t cells_count, formula_offsets_count, addends_count, dependent_offsets_count, dependents_count;
+    std::size_t name_offsets_count, names_size, chain_count;
+    const int32_t* values = reader.GetSection<int32_t>(kValues, cells_count);
+    const uint64_t* formula_offsets = reader.GetSection<uint64_t>(kFormulaOffsets, formula_offsets_count);
+    const int32_t* addends = reader.GetSection<int32_t>(kAddends, addends_count);
+    const uint64_t* dependent_offsets = reader.GetSection<uint64_t>(kDependentOffsets, dependent_offsets_count);
+    const int32_t* dependents = reader.GetSection<int32_t>(kDependents, dependents_count);
+    const uint64_t* name_offsets = reader.GetSection<uint64_t>(kNameOffsets, name_offsets_count);
+    const char* names = reader.GetSection<char>(kNames, names_size);
+    const int32_t* chain = reader.GetSection<int32_t>(kChainNext, chain_count);
+
+    // Checksums catch damaged files, but a file written by a buggy writer should not crash the solution either.
+    auto valid_offsets = [&](const uint64_t* offsets, std::size_t count, std::size_t size) {
+        return count == cells_count + 1 && offsets[0] == 0 && offsets[cells_count] == size;
+    };
+    if (!valid_offsets(formula_offsets, formula_offsets_count, addends_count / 2) ||
+        !valid_offsets(dependent_offsets, dependent_offsets_count, dependents_count) ||
+        !valid_offsets(name_offsets, name_offsets_count, names_size) || chain_count != cells_count) {
+        error = "Sections have different number of cells";
+        return false;
+    }
+    std::vector<int> cells(cells_count);
+    std::iota(cells.begin(), cells.end(), 0);
+    std::atomic<bool> is_consistent{true};
+    std::for_each(std::execution::par_unseq, cells.begin(), cells.end(), [&](int cell) {
+        // Deleted cells have empty names, nothing references them.
+        auto is_deleted = [&](int64_t c) { return name_offsets[c] == name_offsets[c + 1]; };
+        bool ok = formula_offsets[cell] <= formula_offsets[cell + 1] && dependent_offsets[cell] <= dependent_offsets[cell + 1] &&
+            name_offsets[cell] <= name_offsets[cell + 1] && chain[cell] >= -1 && chain[cell] < (int64_t) cells_count;
+        for (uint64_t i = formula_offsets[cell]; ok && i < formula_offsets[cell + 1]; i++) {
+            ok = addends[2 * i] == Addend::VALUE ||
+                (addends[2 * i] == Addend::CELL && addends[2 * i + 1] >= 0 && addends[2 * i + 1] < (int64_t) cells_count &&
+                 !is_deleted(addends[2 * i + 1]));
+        }
+        for (uint64_t i = dependent_offsets[cell]; ok && i < dependent_offsets[cell + 1]; i++) {
+            ok = dependents[i] >= 0 && dependents[i] < (int64_t) cells_count && !is_deleted(dependents[i]);
+        }
+        if (!ok) {
+            is_consistent = false;
+        }
+    });
+    if (!is_consistent) {
+        error = "Snapshot contains wrong cells";
+        return false;
+    }
+
+    AbortLoad();
+    fork_base.reset();
+    FreeCells();
+    std::for_each(std::execution::par_unseq, std::begin(DAG), std::end(DAG), [](Edges& e) { e.clear(); });
+    DAG.resize(cells_count);
+    cell_info.resize(cells_count);
+    chain_next.assign(chain, chain + cells_count);
+    ids.Clear();
+    ids.Reserve(cells_count);
+    ResetOutputOrder();
+    free_cells.clear();
+    ResetJournal();
+    starting_cells.clear();
+    calculated_cells_count = cells_count;
+    plans.clear();
+    edit_count.clear();
+
+    std::atomic<bool> names_are_unique{true};
+    std::for_each(std::execution::par_unseq, cells.begin(), cells.end(), [&](int cell) {
+        Formula formula(formula_offsets[cell + 1] - formula_offsets[cell]);
+        for (std::size_t i = 0; i < formula.size(); i++) {
+            const int32_t* addend = addends + 2 * (formula_offsets[cell] + i);
+            formula[i] = Addend((Addend::Type) addend[0], addend[1]);
+        }
+        std::string_view name(names + name_offsets[cell], name_offsets[cell + 1] - name_offsets[cell]);
+        if (name.empty()) {
+            cell_info[cell] = nullptr;
+            return;
+        }
+        cell_info[cell] = new CellInfo(std::move(formula));
+        cell_info[cell]->value.store(CellValue(true, values[cell]));
+        for (uint64_t i = dependent_offsets[cell]; i < dependent_offsets[cell + 1]; i++) {
+            DAG[cell].push_back(OptionalCell(dependents[i], false));
+        }
+        if (!ids.Insert(name, cell)) {
+            names_are_unique = false;
+        }
+    });
+    if (!names_are_unique) {
+        error = "Snapshot contains the same cell twice";
+        return false;
+    }
+    for (std::size_t cell = cells_count; cell-- > 0;) {
+        if (cell_info[cell] == nullptr) {
+            free_cells.push_back(cell);
+        }
+    }
+    PublishCells(0, cell_info.size());
+    RebuildExports();
+    return true;
+}
+
+// -------------- Forks --------------
+
+std::shared_ptr<const ForkBase> FastSolution::BuildForkBase() {
+    auto base = std::make_shared<ForkBase>();
+    std::size_t cells_count = cell_info.size();
+    std::vector<int> cells(cells_count);
+    std::iota(cells.begin(), cells.end(), 0);
+
+    base->cells_count = cells_count;
+    base->formula_offsets.assign(cells_count + 1, 0);
+    base->dependent_offsets.assign(cells_count + 1, 0);
+    std::for_each(std::execution::par_unseq, cells.begin(), cells.end(), [&](int cell) {
+        base->formula_offsets[cell + 1] = cell_info[cell] != nullptr ? cell_info[cell]->formula.size() : 0;
+        for (const auto& it : DAG[cell]) {
+            base->dependent_offsets[cell + 1] += !it.is_deleted;
+        }
+    });
+    std::partial_sum(base->formula_offsets.begin(), base->formula_offsets.end(), base->formula_offsets.begin());
+    std::partial_sum(base->dependent_offsets.begin(), base->dependent_offsets.end(), base->dependent_offsets.begin());
+
+    base->addends.resize(base->formula_offsets[cells_count]);
+    base->dependents.resize(base->dependent_offsets[cells_count]);
+    base->value_pages.resize((cells_count + ForkBase::kPageSize - 1) / ForkBase::kPageSize);
+    for (auto& it : base->value_pages) {
+        it = std::make_shared<ForkBase::ValuePage>();
+    }
+    std::for_each(std::execution::par_unseq, cells.begin(), cells.end(), [&](int cell) {
+        if (cell_info[cell] != nullptr) {
+            std::copy(cell_info[cell]->formula.begin(), cell_info[cell]->formula.end(),
+                base->addends.begin() + base->formula_offsets[cell]);
+        }
+        uint64_t dependent = base->dependent_offsets[cell];
+        for (const auto& it : DAG[cell]) {
+            if (!it.is_deleted) {
+                base->dependents[dependent++] = it.cell;
+            }
+        }
+        (*base->value_pages[cell >> ForkBase::kPageBits])[cell & (ForkBase::kPageSize - 1)] = GetCellValue(cell);
+    });
+    return base;
+}
+
+std::shared_ptr<const ForkBase> FastSolution::GetForkBase() {
+    if (!fork_base) {
+#ifdef _DEBUG
+        Timer timer("        Fork base building time: ");
+#endif
+        fork_base = BuildForkBase();
+    }
+    return fork_base;
+}
+
+SolutionFork FastSolution::Fork() {
+    return SolutionFork(GetForkBase());
 }
 
 // -------------- Change formula of a cell --------------
 
+// Edit is value-only if new formula references exactly the same cells (with multiplicity) as old one.
+// Such edit doesn't change DAG.
+bool FastSolution::HaveSameReferences(const Formula& a, const Formula& b) {
+    std::vector<int> a_cells, b_cells;
+    for (const auto& it : a) {
+        if (it.type == Addend::CELL) {
+            a_cells.push_back(it.value);
+        }
+    }
+    for (const auto& it : b) {
+        if (it.type == Addend::CELL) {
+            b_cells.push_back(it.value);
+        }
+    }
+    if (a_cells.size() != b_cells.size()) {
+        return false;
+    }
+    std::sort(a_cells.begin(), a_cells.end());
+    std::sort(b_cells.begin(), b_cells.end());
+    return a_cells == b_cells;
+}
 
-void FastSolution::RecalculateDAG(int cell, const Formula& formula) {
+void FastSolution::RecalculateDAG(int cell, Formula formula) {
     // Not really critical number of operations, we can do it in one thread.     
     for (const auto& formula_it : cell_info[cell]->formula) {
         if (formula_it.type == Addend::CELL) {
@@ -193,24 +829,40 @@ void FastSolution::RecalculateDAG(int cell, const Formula& formula) {
             }
         }
     }
-    cell_info[cell]->formula = formula;
+    Formula old_formula = std::move(cell_info[cell]->formula);
+    cell_info[cell]->formula = std::move(formula);
 
     for (const auto& formula_it : cell_info[cell]->formula) {
         if (formula_it.type == Addend::CELL) {
             DAG[formula_it.value].push_back(OptionalCell(cell, false));
         }
     }
+
+    // Split or merge chains around the cell: out-degree of old and new precedents is changed,
+    // in-degree of the cell is changed.
+    for (const auto& formula_it : old_formula) {
+        if (formula_it.type == Addend::CELL) {
+            CompactEdges(formula_it.value);
+            UpdateChainLink(formula_it.value);
+        }
+    }
+    for (const auto& formula_it : cell_info[cell]->formula) {
+        if (formula_it.type == Addend::CELL) {
+            UpdateChainLink(formula_it.value);
+        }
+    }
 }
 
 void FastSolution::RecalculateCellsThreadJob() {
     int cells_count = cell_info.size();
     int cell;
+    bool has_continuation = false;
 
     while (calculated_cells_count.load(std::memory_order_seq_cst) < cells_count) {
-        bool success = lock_free_queue.try_dequeue(cell);
-        if (!success) {
+        if (!has_continuation && !lock_free_queue.try_dequeue(cell)) {
             continue;
         }
+        has_continuation = false;
 
         auto& c_info = cell_info[cell];
         auto cell_value = c_info->value.load();
@@ -235,14 +887,20 @@ void FastSolution::RecalculateCellsThreadJob() {
         }
 
         calculated_cells_count++;
+        int tail = EvaluateChainTail(cell);
         
-        for (const auto& it : DAG[cell]) {
+        for (const auto& it : DAG[tail]) {
             int next = it.cell;
             if (!it.is_deleted) {
                 auto next_info = cell_info.at(next);
                 int unresolved_count = next_info->unresolved_cells_count.fetch_sub(1) - 1;
                 if (unresolved_count == 0) {
-                    lock_free_queue.enqueue(next);
+                    if (has_continuation) {
+                        lock_free_queue.enqueue(next);
+                    } else {
+                        cell = next;
+                        has_continuation = true;
+                    }
                 }
             }
         }
@@ -266,6 +924,23 @@ void FastSolution::FindRecalculationCellsThreadJob() {
 
             count_to_recalculate++;
             need_to_recalculate.push_back(cell);
+            if (journal_budget > 0) {
+                marked_values.push_back({ cell, cell_value.value });
+            }
+
+            // Chain cells are reachable only through the chain, mark them without the queue.
+            for (int next = chain_next[cell]; next != -1; next = chain_next[cell]) {
+                auto next_value = cell_info[next]->value.load();
+                if (!next_value.is_calculated || !cell_info[next]->value.compare_exchange_strong(next_value, CellValue(false, 0))) {
+                    break;
+                }
+                cell = next;
+                count_to_recalculate++;
+                need_to_recalculate.push_back(cell);
+                if (journal_budget > 0) {
+                    marked_values.push_back({ cell, next_value.value });
+                }
+            }
 
             for (const auto& it : DAG[cell]) {
                 int next = it.cell;
@@ -278,27 +953,119 @@ void FastSolution::FindRecalculationCellsThreadJob() {
 }
 
 
-void FastSolution::ChangeCell(const std::string& cell, const Formula& formula) {
-    int cell_id = id_by_name[cell];
-    RecalculateDAG(cell_id, formula);
-     
+// -------------- Recalculation plans of hot cells --------------
+
+// Topologically sorts cells found by the last ChangeCell (all cells reachable from 'cell') and splits them into levels.
+void FastSolution::BuildRecalculationPlan(int cell) {
+    std::unordered_map<int, int> unresolved;
+    unresolved.reserve(need_to_recalculate.size());
+    for (const auto& it : need_to_recalculate) {
+        for (const auto& edge : DAG[it]) {
+            if (!edge.is_deleted) {
+                unresolved[edge.cell]++;
+            }
+        }
+    }
+
+    if (plans.size() >= kMaxCachedPlans) {
+        auto oldest = std::min_element(plans.begin(), plans.end(), [](const auto& a, const auto& b) {
+            return a.second.last_used < b.second.last_used;
+        });
+        plans.erase(oldest);
+    }
+
+    RecalculationPlan& plan = plans[cell];
+    plan.cells.reserve(need_to_recalculate.size());
+    plan.cells.push_back(cell);
+    plan.level_bounds.push_back(0);
+    std::size_t level_begin = 0;
+    while (level_begin < plan.cells.size()) {
+        std::size_t level_end = plan.cells.size();
+        plan.level_bounds.push_back(level_end);
+        for (std::size_t i = level_begin; i < level_end; i++) {
+            for (const auto& edge : DAG[plan.cells[i]]) {
+                if (!edge.is_deleted && --unresolved[edge.cell] == 0) {
+                    plan.cells.push_back(edge.cell);
+                }
+            }
+        }
+        level_begin = level_end;
+    }
+
+    plan.sorted_cells = plan.cells;
+    std::sort(plan.sorted_cells.begin(), plan.sorted_cells.end());
+    plan.last_used = ++plans_clock;
+}
+
+// Structural edit of 'cell' changes edges going into it. It affects every plan which contains 'cell'
+// (old edges are removed) or one of new precedents of 'cell' (cell becomes reachable).
+void FastSolution::InvalidateRecalculationPlans(int cell, const Formula& formula) {
+    auto contains = [](const RecalculationPlan& plan, int c) {
+        return std::binary_search(plan.sorted_cells.begin(), plan.sorted_cells.end(), c);
+    };
+
+    for (auto it = plans.begin(); it != plans.end();) {
+        bool invalid = contains(it->second, cell);
+        for (const auto& formula_it : formula) {
+            if (invalid) {
+                break;
+            }
+            invalid = formula_it.type == Addend::CELL && contains(it->second, formula_it.value);
+        }
+        it = invalid ? plans.erase(it) : std::next(it);
+    }
+}
+
+// Evaluates cells level by level. There is no need to find reachable cells and count unresolved ones,
+// and small levels are evaluated in the current thread.
+void FastSolution::EvaluateRecalculationPlan(const RecalculationPlan& plan) {
+    auto evaluate = [&](int cell) {
+        auto& info = cell_info[cell];
+        info->value.store(CellValue(true, CalculateCellValue(cell, info->formula)));
+    };
+
+    for (std::size_t level = 0; level + 1 < plan.level_bounds.size(); level++) {
+        auto begin = plan.cells.begin() + plan.level_bounds[level];
+        auto end = plan.cells.begin() + plan.level_bounds[level + 1];
+        if (end - begin < kParallelLevelSize) {
+            std::for_each(begin, end, evaluate);
+        } else {
+            std::for_each(std::execution::par_unseq, begin, end, evaluate);
+        }
+    }
+    UpdateExports(plan.cells);
+}
+
+// ----------------------------
+
+// Recalculates all cells which are reachable from changed cells. Formulas and DAG are already updated.
+void FastSolution::RecalculateCells(const std::vector<int>& changed_cells) {
     // Find cells which we need to recalculate
     {
 #ifdef _DEBUG
         Timer timer("FindRecalculationCellsThreadJob time: ");
 #endif
         count_to_recalculate = 0;
+        need_to_recalculate.clear();
+        marked_values.clear();
         lock_free_queue = moodycamel::BlockingConcurrentQueue<int>(cell_info.size());
-        lock_free_queue.enqueue(cell_id);
+        for (int cell : changed_cells) {
+            lock_free_queue.enqueue(cell);
+        }
         done_consumers = 0;
         runMultipleThreads([&]() { FindRecalculationCellsThreadJob(); });
     }
+    RecalculateMarkedCells();
+}
 
+// Evaluates cells of need_to_recalculate, they should be marked as not calculated.
+void FastSolution::RecalculateMarkedCells() {
     // Calculate number of cells in formula which are not calculated
     {
 #ifdef _DEBUG
         Timer timer("count_unresolved_cells time: ");
 #endif
+        lock_free_queue = moodycamel::BlockingConcurrentQueue<int>(count_to_recalculate.load());
         auto count_unresolved_cells = [&](int to_recalculate) {
             auto& info = cell_info.at(to_recalculate);
             int cnt = 0;
@@ -311,6 +1078,10 @@ void FastSolution::ChangeCell(const std::string& cell, const Formula& formula) {
                 }
             }
             info->unresolved_cells_count.store(cnt);
+            // Changed cells and cells which depend only on cells which are not changed start the recalculation.
+            if (cnt == 0) {
+                lock_free_queue.enqueue(to_recalculate);
+            }
         };
         auto lambda = [&](int it) { count_unresolved_cells(it); };
         std::for_each(std::execution::par_unseq, std::begin(need_to_recalculate), std::end(need_to_recalculate), lambda);
@@ -319,7 +1090,7 @@ void FastSolution::ChangeCell(const std::string& cell, const Formula& formula) {
 #ifdef _DEBUG
     int cnt = 0;
     for (auto it : cell_info) {
-        cnt += !it->value.load().is_calculated;
+        cnt += it != nullptr && !it->value.load().is_calculated;
     }
     if (cnt != count_to_recalculate.load()) {
         std::cout << std::endl << "FAIL!!! [FindRecalculationCellsThreadJob] count_to_recalculate is wrong" << std::endl;
@@ -334,30 +1105,700 @@ void FastSolution::ChangeCell(const std::string& cell, const Formula& formula) {
 #ifdef _DEBUG
         Timer timer("RecalculateCellsThreadJob time: ");
 #endif
-        lock_free_queue = moodycamel::BlockingConcurrentQueue<int>(count_to_recalculate.load());
-        lock_free_queue.enqueue(cell_id);
         calculated_cells_count = cell_info.size() - count_to_recalculate.load();
         runMultipleThreads([&]() { RecalculateCellsThreadJob(); });
     }
 
 #ifdef _DEBUG
-    for (auto it : cell_info) {
-        if (!it->value.load().is_calculated) {
-            std::cout << std::endl << "FAIL!!! [RecalculateCellsThreadJob] there is not calculated cell " << it->name << std::endl;
+    for (std::size_t cell = 0; cell < cell_info.size(); cell++) {
+        if (cell_info[cell] != nullptr && !cell_info[cell]->value.load().is_calculated) {
+            std::cout << std::endl << "FAIL!!! [RecalculateCellsThreadJob] there is not calculated cell " << ids.GetName(cell) << std::endl;
             exit(1);
         }
     }
 #endif
+    UpdateExports(need_to_recalculate);
+}
+
+void FastSolution::ChangeCell(const std::string& cell, const Formula& formula) {
+    ChangeCell(cell, Formula(formula));
+}
+
+void FastSolution::ChangeCell(const std::string& cell, Formula&& formula) {
+    int cell_id = ids.Find(cell);
+    if (cell_id == -1) {
+        AddCell(cell, std::move(formula));
+        return;
+    }
+    ChangeCell(cell_id, std::move(formula));
+}
+
+bool FastSolution::ReplaceFormula(int cell, Formula formula) {
+    if (HaveSameReferences(cell_info[cell]->formula, formula)) {
+        cell_info[cell]->formula = std::move(formula);
+        return true;
+    }
+    InvalidateRecalculationPlans(cell, formula);
+    RecalculateDAG(cell, std::move(formula));
+    return false;
+}
+
+bool FastSolution::ChangeCell(int cell_id, Formula&& formula) {
+    if (cell_id < 0 || cell_id >= (int) cell_info.size() || cell_info[cell_id] == nullptr) {
+        return false;
+    }
+    fork_base.reset();
+    ResolveReferences(formula);
+    JournalEntry entry;
+    if (journal_budget > 0) {
+        entry.edited_cells.push_back(cell_id);
+        entry.old_formulas.push_back(cell_info[cell_id]->formula);
+        entry.new_formulas.push_back(formula);
+    }
+    bool value_only = ReplaceFormula(cell_id, std::move(formula));
+
+    auto plan = plans.find(cell_id);
+    if (plan != plans.end()) {
+        plan->second.last_used = ++plans_clock;
+        if (journal_budget > 0) {
+            entry.cells = plan->second.cells;
+            for (int cell : entry.cells) {
+                entry.old_values.push_back(cell_info[cell]->value.load().value);
+            }
+        }
+        EvaluateRecalculationPlan(plan->second);
+        AddJournalEntry(std::move(entry));
+        return true;
+    }
+     
+    RecalculateCells({ cell_id });
+    TakeMarkedValues(entry);
+    AddJournalEntry(std::move(entry));
+
+    // Value-only edits of hot cells will reuse the plan and skip the steps above.
+    if (value_only && ++edit_count[cell_id] >= kHotEditCount) {
+        BuildRecalculationPlan(cell_id);
+    }
+    return true;
+}
+
+// Formulas of all cells are changed first, then cells which are reachable from any of them are recalculated once.
+void FastSolution::ChangeCells(const InputData& edits) {
+    if (edits.empty()) {
+        return;
+    }
+    fork_base.reset();
+    std::vector<int> changed_cells;
+    changed_cells.reserve(edits.size());
+    JournalEntry entry;
+    bool has_added_cells = false;
+    for (const auto& it : edits) {
+        int cell_id = ids.Find(it.name);
+        if (cell_id == -1) {
+            // It is evaluated at once and is recalculated below if it depends on changed cells.
+            AddCell(it.name, it.formula);
+            has_added_cells = true;
+            continue;
+        }
+        Formula formula = it.formula;
+        ResolveReferences(formula);
+        if (journal_budget > 0) {
+            entry.edited_cells.push_back(cell_id);
+            entry.old_formulas.push_back(cell_info[cell_id]->formula);
+            entry.new_formulas.push_back(formula);
+        }
+        ReplaceFormula(cell_id, std::move(formula));
+        changed_cells.push_back(cell_id);
+    }
+    if (!changed_cells.empty()) {
+        RecalculateCells(changed_cells);
+    }
+    // AddCell() cleared the journal, the edit can't be undone.
+    if (!has_added_cells) {
+        TakeMarkedValues(entry);
+        AddJournalEntry(std::move(entry));
+    }
+}
+
+// -------------- Undo/redo journal --------------
+
+void FastSolution::EnableJournal(std::size_t memory_budget) {
+    ResetJournal();
+    journal_budget = memory_budget;
+}
+
+void FastSolution::ResetJournal() {
+    journal.clear();
+    journal_position = 0;
+    journal_bytes = 0;
+}
+
+void FastSolution::TakeMarkedValues(JournalEntry& entry) {
+    if (journal_budget == 0) {
+        return;
+    }
+    entry.cells.reserve(marked_values.size());
+    entry.old_values.reserve(marked_values.size());
+    for (const auto& it : marked_values) {
+        entry.cells.push_back(it.first);
+        entry.old_values.push_back(it.second);
+    }
+}
+
+// Entries which could be redone are dropped by a new edit, the oldest entries are evicted to fit the budget.
+void FastSolution::AddJournalEntry(JournalEntry&& entry) {
+    if (journal_budget == 0) {
+        return;
+    }
+    entry.new_values.resize(entry.cells.size());
+    for (std::size_t i = 0; i < entry.cells.size(); i++) {
+        entry.new_values[i] = cell_info[entry.cells[i]]->value.load().value;
+    }
+    entry.bytes = sizeof(JournalEntry) + entry.cells.size() * (sizeof(int) + 2 * sizeof(ValueType));
+    for (std::size_t i = 0; i < entry.edited_cells.size(); i++) {
+        entry.bytes += sizeof(int) + 2 * sizeof(Formula) +
+            (entry.old_formulas[i].size() + entry.new_formulas[i].size()) * sizeof(Addend);
+    }
+
+    while (journal.size() > journal_position) {
+        journal_bytes -= journal.back().bytes;
+        journal.pop_back();
+    }
+    journal_bytes += entry.bytes;
+    journal.push_back(std::move(entry));
+    journal_position++;
+    while (journal_bytes > journal_budget && !journal.empty()) {
+        journal_bytes -= journal.front().bytes;
+        journal.pop_front();
+        journal_position--;
+    }
+}
+
+// Formulas are put back in reverse order of the edit (a batch can edit a cell twice), then values are stored.
+void FastSolution::ApplyJournalEntry(const JournalEntry& entry, bool undo) {
+    fork_base.reset();
+    std::size_t edited_count = entry.edited_cells.size();
+    for (std::size_t i = 0; i < edited_count; i++) {
+        std::size_t edit = undo ? edited_count - 1 - i : i;
+        ReplaceFormula(entry.edited_cells[edit], undo ? entry.old_formulas[edit] : entry.new_formulas[edit]);
+    }
+
+    const std::vector<ValueType>& values = undo ? entry.old_values : entry.new_values;
+    std::vector<std::size_t> indices(entry.cells.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    auto store = [&](std::size_t i) { cell_info[entry.cells[i]]->value.store(CellValue(true, values[i])); };
+    if (indices.size() < kParallelLevelSize) {
+        std::for_each(indices.begin(), indices.end(), store);
+    } else {
+        std::for_each(std::execution::par_unseq, indices.begin(), indices.end(), store);
+    }
+    UpdateExports(entry.cells);
+}
+
+bool FastSolution::Undo() {
+    if (journal_position == 0) {
+        return false;
+    }
+    ApplyJournalEntry(journal[--journal_position], true);
+    return true;
+}
+
+bool FastSolution::Redo() {
+    if (journal_position == journal.size()) {
+        return false;
+    }
+    ApplyJournalEntry(journal[journal_position++], false);
+    return true;
+}
+
+// -------------- Insertion and deletion of cells --------------
+
+void FastSolution::ResolveReferences(Formula& formula) const {
+    for (auto& it : formula) {
+        if (it.type == Addend::CELL && (it.value < 0 || it.value >= (int) cell_info.size() || cell_info[it.value] == nullptr)) {
+            it = Addend(Addend::VALUE, kReferenceError);
+        }
+    }
+}
+
+bool FastSolution::AddCell(std::string_view name, Formula formula) {
+    if (ids.Find(name) != -1) {
+        return false;
+    }
+    fork_base.reset();
+    ResetJournal();
+    ResolveReferences(formula);
+
+    int cell;
+    if (!free_cells.empty()) {
+        cell = free_cells.back();
+        free_cells.pop_back();
+    } else {
+        cell = cell_info.size();
+        ids.Reserve(cell + 1);
+        DAG.grow_by(1);
+        cell_info.push_back(nullptr);
+        chain_next.push_back(-1);
+    }
+    ids.Insert(name, cell);
+
+    CellInfo* info = new CellInfo(std::move(formula));
+    cell_info[cell] = info;
+    for (const auto& it : info->formula) {
+        if (it.type == Addend::CELL) {
+            DAG[it.value].push_back(OptionalCell(cell, false));
+        }
+    }
+    for (const auto& it : info->formula) {
+        if (it.type == Addend::CELL) {
+            UpdateChainLink(it.value);
+        }
+    }
+    InvalidateRecalculationPlans(cell, info->formula);
+    info->value.store(CellValue(true, CalculateCellValue(cell, info->formula)));
+    InsertIntoOutputOrder(cell);
+
+    PublishCells(cell, cell + 1);
+    UpdateExports(std::vector<int>{ cell });
+    epochs.Reclaim();
+    return true;
+}
+
+bool FastSolution::DeleteCell(std::string_view name) {
+    int cell = ids.Find(name);
+    if (cell == -1) {
+        return false;
+    }
+    fork_base.reset();
+    ResetJournal();
+
+    // The id will be given to another cell, so references of dependents are replaced.
+    std::vector<int> dependents;
+    for (const auto& it : DAG[cell]) {
+        if (!it.is_deleted) {
+            dependents.push_back(it.cell);
+        }
+    }
+    std::sort(dependents.begin(), dependents.end());
+    dependents.erase(std::unique(dependents.begin(), dependents.end()), dependents.end());
+    for (int dependent : dependents) {
+        Formula formula = cell_info[dependent]->formula;
+        for (auto& it : formula) {
+            if (it.type == Addend::CELL && it.value == cell) {
+                it = Addend(Addend::VALUE, kReferenceError);
+            }
+        }
+        InvalidateRecalculationPlans(dependent, formula);
+        RecalculateDAG(dependent, std::move(formula));
+    }
+
+    // Edges from precedents are marked as deleted, chains and plans which go through the cell are split.
+    InvalidateRecalculationPlans(cell, Formula());
+    RecalculateDAG(cell, Formula());
+    plans.erase(cell);
+    edit_count.erase(cell);
+    DAG[cell].clear();
+    chain_next[cell] = -1;
+
+    // Readers of other threads can still use the cell, so it is freed later.
+    RemoveFromOutputOrder(cell);
+    CellInfo* info = cell_info[cell];
+    cell_info[cell] = nullptr;
+    published_cells[cell].info.store(nullptr);
+    epochs.Retire(info);
+    ids.Remove(cell);
+    free_cells.insert(std::lower_bound(free_cells.begin(), free_cells.end(), cell, std::greater<int>()), cell);
+
+    if (!dependents.empty()) {
+        RecalculateCells(dependents);
+    } else {
+        UpdateExports(dependents);
+    }
+    if (is_columnar_export_enabled) {
+        dense_values[cell] = kReferenceError;
+        last_changed_cells.push_back(cell);
+    }
+    epochs.Reclaim();
+    return true;
+}
+
+bool FastSolution::ReadValue(std::string_view name, ValueType& value) {
+    EpochReclaimer::Guard guard(epochs);
+    int cell = ids.Find(name);
+    if (cell < 0 || cell >= published_count.load(std::memory_order_acquire)) {
+        return false;
+    }
+    CellInfo* info = published_cells[cell].info.load(std::memory_order_acquire);
+    if (info == nullptr) {
+        return false;
+    }
+    CellValue cell_value = info->value.load();
+    // The cell could be deleted and its id could be given to another cell after the name was found.
+    if (!cell_value.is_calculated || ids.Find(name) != cell) {
+        return false;
+    }
+    value = cell_value.value;
+    return true;
+}
+
+// Cells [begin, end) are published, the table grows to the number of cells if it is needed.
+void FastSolution::PublishCells(int begin, int end) {
+    if (published_cells.size() < cell_info.size()) {
+        published_cells.grow_by(cell_info.size() - published_cells.size());
+    }
+    for (int cell = begin; cell < end; cell++) {
+        published_cells[cell].info.store(cell_info[cell], std::memory_order_release);
+    }
+    published_count.store(cell_info.size(), std::memory_order_release);
+}
+
+// -------------- Append of new cells --------------
+
+bool FastSolution::AppendCells(const InputData& cells, std::string& error) {
+    return AppendInputCells(cells, error);
+}
+
+bool FastSolution::AppendCells(InputData&& cells, std::string& error) {
+    return AppendInputCells(cells, error);
+}
+
+// New cells are added the same way as InitialCalculate() adds cells, then they are marked as not calculated
+// and evaluated by the recalculation. Loaded cells are not visited except precedents of the new cells.
+template <typename Input>
+bool FastSolution::AppendInputCells(Input& cells, std::string& error) {
+    int old_count = cell_info.size();
+    int new_count = old_count + cells.size();
+
+    // Everything is checked before the solution is changed.
+    std::vector<char> is_added(cells.size(), 0);
+    for (const auto& it : cells) {
+        if (it.id < old_count || it.id >= new_count || is_added[it.id - old_count]) {
+            error = "Ids of new cells should be unique and follow ids of loaded cells";
+            return false;
+        }
+        is_added[it.id - old_count] = 1;
+    }
+    std::atomic<bool> is_valid{true};
+    std::for_each(std::execution::par_unseq, std::begin(cells), std::end(cells), [&](const InputCellInfo& it) {
+        bool ok = ids.Find(it.name) == -1;
+        for (const auto& formula_it : it.formula) {
+            ok = ok && (formula_it.type != Addend::CELL || (formula_it.value >= 0 && formula_it.value < new_count &&
+                                                            (formula_it.value >= old_count || cell_info[formula_it.value] != nullptr)));
+        }
+        if (!ok) {
+            is_valid = false;
+        }
+    });
+    if (!is_valid) {
+        error = "New cell already exists or references unknown or deleted cell";
+        return false;
+    }
+    std::vector<std::string_view> names(cells.size());
+    std::transform(std::begin(cells), std::end(cells), names.begin(), [](const InputCellInfo& it) { return std::string_view(it.name); });
+    std::sort(std::execution::par_unseq, names.begin(), names.end());
+    if (std::adjacent_find(names.begin(), names.end()) != names.end()) {
+        error = "Names of new cells should be unique";
+        return false;
+    }
+
+    fork_base.reset();
+    ResetJournal();
+    {
+#ifdef _DEBUG
+        Timer timer("        Appending to DAG time: ");
+#endif
+        ids.Reserve(new_count);
+        DAG.grow_by(cells.size());
+        cell_info.resize(new_count);
+        chain_next.resize(new_count, -1);
+        starting_cells.clear();
+        BuildDAG(true, cells);
+
+        // Out-degree of loaded precedents is changed, so their chain links and plans which contain them are updated.
+        std::vector<int> precedents;
+        for (const auto& it : cells) {
+            for (const auto& formula_it : cell_info[it.id]->formula) {
+                if (formula_it.type == Addend::CELL && formula_it.value < old_count) {
+                    precedents.push_back(formula_it.value);
+                }
+            }
+        }
+        std::sort(std::execution::par_unseq, precedents.begin(), precedents.end());
+        precedents.erase(std::unique(precedents.begin(), precedents.end()), precedents.end());
+        for (auto it = plans.begin(); it != plans.end();) {
+            const auto& sorted_cells = it->second.sorted_cells;
+            bool invalid = std::any_of(precedents.begin(), precedents.end(), [&](int cell) {
+                return std::binary_search(sorted_cells.begin(), sorted_cells.end(), cell);
+            });
+            it = invalid ? plans.erase(it) : std::next(it);
+        }
+        std::for_each(std::execution::par_unseq, precedents.begin(), precedents.end(), [&](int cell) { UpdateChainLink(cell); });
+        std::for_each(std::execution::par_unseq, std::begin(cells), std::end(cells),
+            [&](const InputCellInfo& it) { UpdateChainLink(it.id); });
+    }
+
+    count_to_recalculate = cells.size();
+    need_to_recalculate.clear();
+    for (const auto& it : cells) {
+        need_to_recalculate.push_back(it.id);
+    }
+    PublishCells(old_count, new_count);
+    RecalculateMarkedCells();
+    return true;
 }
 
 // -------------- Return current state of cells --------------
 
 OutputData FastSolution::GetCurrentValues() {
     OutputData result = OutputData();
-    for (const auto& cell : cell_info) {
-        result[cell->name] = cell->value.load().value;
+    for (std::size_t cell = 0; cell < cell_info.size(); cell++) {
+        if (cell_info[cell] != nullptr) {
+            result[ids.GetName(cell)] = cell_info[cell]->value.load().value;
+        }
     }
     return result;
 }
 
+ValueType FastSolution::GetCellValue(int cell) const {
+    return cell_info[cell] != nullptr ? cell_info[cell]->value.load().value : kReferenceError;
+}
+
+void FastSolution::ResetOutputOrder() {
+    output_order.clear();
+    ordered_ids_count = 0;
+    output_record.clear();
+}
+
+// Only cells which are added since the last call are sorted, then they are merged into the kept order.
+// Deleted cells are skipped.
+void FastSolution::UpdateOutputOrder() {
+    std::size_t ordered_count = ordered_ids_count;
+    if (ordered_count == cell_info.size()) {
+        return;
+    }
+    ordered_ids_count = cell_info.size();
+    std::vector<int> new_cells(cell_info.size() - ordered_count);
+    std::iota(new_cells.begin(), new_cells.end(), (int) ordered_count);
+    if (!free_cells.empty()) {
+        new_cells.erase(std::remove_if(new_cells.begin(), new_cells.end(), [&](int cell) { return cell_info[cell] == nullptr; }),
+                        new_cells.end());
+    }
+    std::vector<uint64_t> keys(new_cells.size());
+    std::transform(std::execution::par_unseq, new_cells.begin(), new_cells.end(), keys.begin(),
+                   [&](int cell) { return ids.GetSortKey(cell); });
+    ParallelRadixSort(keys, new_cells);
+
+    if (output_order.empty()) {
+        output_order = std::move(new_cells);
+        return;
+    }
+    std::vector<int> merged(output_order.size() + new_cells.size());
+    std::merge(std::execution::par_unseq, output_order.begin(), output_order.end(), new_cells.begin(), new_cells.end(),
+               merged.begin(), [&](int a, int b) { return ids.GetSortKey(a) < ids.GetSortKey(b); });
+    output_order = std::move(merged);
+}
+
+// Position of the cell in the kept output order by its sort key, ties are ordered by id as in the merge above.
+std::size_t FastSolution::FindOutputRecord(int cell) const {
+    uint64_t key = ids.GetSortKey(cell);
+    auto it = std::lower_bound(output_order.begin(), output_order.end(), cell, [&](int a, int b) {
+        uint64_t a_key = ids.GetSortKey(a);
+        return a_key < key || (a_key == key && a < b);
+    });
+    return it - output_order.begin();
+}
+
+// A deleted cell is removed from the kept order in place of a new sort, its record is removed from the patched output.
+// Records after it are moved, so their numbers are decreased.
+void FastSolution::RemoveFromOutputOrder(int cell) {
+    if (cell >= (int) ordered_ids_count) {
+        return;
+    }
+    std::size_t record = FindOutputRecord(cell);
+    output_order.erase(output_order.begin() + record);
+    if (!patched_output || output_record.size() != cell_info.size()) {
+        return;
+    }
+    output_record[cell] = -1;
+    for (std::size_t i = record; i < output_order.size(); i++) {
+        output_record[output_order[i]] = i;
+    }
+    if (patched_output->IsOpen()) {
+        patched_output->RemoveRecord(record);
+    }
+}
+
+// A cell which reuses an id less than ordered_ids_count is inserted into the kept order. Cells with greater ids
+// are merged by UpdateOutputOrder() later. The patched output is written again only if the record doesn't fit.
+void FastSolution::InsertIntoOutputOrder(int cell) {
+    if (cell >= (int) ordered_ids_count) {
+        return;
+    }
+    std::size_t record = FindOutputRecord(cell);
+    output_order.insert(output_order.begin() + record, cell);
+    if (!patched_output || output_record.size() != cell_info.size()) {
+        return;
+    }
+    for (std::size_t i = record; i < output_order.size(); i++) {
+        output_record[output_order[i]] = i;
+    }
+    if (!patched_output->IsOpen() ||
+        !patched_output->InsertRecord(record, ids.GetName(cell), cell_info[cell]->value.load().value)) {
+        WritePatchedOutput();
+    }
+}
+
+const std::vector<int>& FastSolution::GetOutputOrder() {
+    UpdateOutputOrder();
+    return output_order;
+}
+
+std::vector<ValueType> FastSolution::GetValuesById() {
+    std::vector<ValueType> values(cell_info.size());
+    std::for_each(std::execution::par_unseq, output_order.begin(), output_order.end(), [&](int cell) {
+        values[cell] = cell_info[cell]->value.load().value;
+    });
+    return values;
+}
+
+std::size_t FastSolution::WriteCurrentValues(const std::string& file_path) {
+    UpdateOutputOrder();
+    return Writer::write_ordered(output_order, ids, GetValuesById(), file_path);
+}
+
+AsyncFileIO& FastSolution::GetAsyncIO() {
+    if (!async_io) {
+        async_io = std::make_unique<AsyncFileIO>();
+    }
+    return *async_io;
+}
+
+void FastSolution::WriteCurrentValuesAsync(const std::string& file_path) {
+    UpdateOutputOrder();
+    Writer::write_ordered_async(output_order, ids, GetValuesById(), file_path, GetAsyncIO());
+}
+
+bool FastSolution::WaitAsyncWrites() {
+    return !async_io || async_io->WaitAll();
+}
+
+Span<ValueType> FastSolution::GetValues() {
+    if (!is_columnar_export_enabled) {
+        is_columnar_export_enabled = true;
+        RebuildExports();
+    }
+    return Span<ValueType>(dense_values.data(), dense_values.size());
+}
+
+Span<int> FastSolution::GetLastChangedCells() {
+    GetValues();
+    return Span<int>(last_changed_cells.data(), last_changed_cells.size());
+}
+
+void FastSolution::GetNames(std::vector<uint64_t>& offsets, std::vector<char>& names) {
+    std::vector<int> cells(cell_info.size());
+    std::iota(cells.begin(), cells.end(), 0);
+    offsets.assign(cells.size() + 1, 0);
+    std::for_each(std::execution::par_unseq, cells.begin(), cells.end(), [&](int cell) {
+        offsets[cell + 1] = ids.GetName(cell).size();
+    });
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    names.resize(offsets.back());
+    std::for_each(std::execution::par_unseq, cells.begin(), cells.end(), [&](int cell) {
+        std::string name = ids.GetName(cell);
+        std::copy(name.begin(), name.end(), names.begin() + offsets[cell]);
+    });
+}
+
+bool FastSolution::ExportValues(const std::string& file_path, bool with_names, bool with_changed_cells) {
+    std::vector<uint64_t> name_offsets;
+    std::vector<char> names;
+    if (with_names) {
+        GetNames(name_offsets, names);
+    }
+    Span<ValueType> values = GetValues();
+    Span<int> changed_cells = with_changed_cells ? GetLastChangedCells() : Span<int>();
+    return ColumnarExport::Write(file_path, name_offsets, names, values, changed_cells);
+}
+
+bool FastSolution::EnablePatchedOutput(const std::string& file_path) {
+    patched_output = std::make_unique<PatchedOutputFile>();
+    patched_output_path = file_path;
+    return WritePatchedOutput();
+}
+
+bool FastSolution::WritePatchedOutput() {
+    UpdateOutputOrder();
+    std::size_t name_width = std::transform_reduce(std::execution::par_unseq, output_order.begin(), output_order.end(),
+        std::size_t(1), [](std::size_t a, std::size_t b) { return std::max(a, b); },
+        [&](int cell) { return ids.GetName(cell).size(); });
+    if (!patched_output->Create(patched_output_path, output_order.size(), name_width)) {
+        std::cout << "Cannot create the file " << patched_output_path << std::endl;
+        return false;
+    }
+
+    output_record.assign(cell_info.size(), -1);
+    std::vector<int> records(output_order.size());
+    std::iota(records.begin(), records.end(), 0);
+    std::for_each(std::execution::par_unseq, records.begin(), records.end(), [&](int record) {
+        int cell = output_order[record];
+        output_record[cell] = record;
+        patched_output->SetRecord(record, ids.GetName(cell), cell_info[cell]->value.load().value);
+    });
+    return true;
+}
+
+// Exports are written from scratch after loads.
+void FastSolution::RebuildExports() {
+    if (is_columnar_export_enabled) {
+        dense_values.resize(cell_info.size());
+        std::vector<int> cells(cell_info.size());
+        std::iota(cells.begin(), cells.end(), 0);
+        std::for_each(std::execution::par_unseq, cells.begin(), cells.end(), [&](int cell) {
+            dense_values[cell] = GetCellValue(cell);
+        });
+        last_changed_cells.clear();
+    }
+    if (patched_output) {
+        WritePatchedOutput();
+    }
+}
+
+// Only cells which were recalculated are written to exports, so the cost doesn't depend on the number of cells.
+template <typename Cells>
+void FastSolution::UpdateExports(const Cells& recalculated_cells) {
+    if (is_columnar_export_enabled) {
+        // Appended cells are recalculated ones, so they are written below.
+        if (dense_values.size() > cell_info.size()) {
+            RebuildExports();
+            return;
+        }
+        dense_values.resize(cell_info.size());
+        last_changed_cells.assign(std::begin(recalculated_cells), std::end(recalculated_cells));
+        auto update = [&](int cell) { dense_values[cell] = cell_info[cell]->value.load().value; };
+        if (recalculated_cells.size() < kParallelLevelSize) {
+            std::for_each(std::begin(recalculated_cells), std::end(recalculated_cells), update);
+        } else {
+            std::for_each(std::execution::par_unseq, std::begin(recalculated_cells), std::end(recalculated_cells), update);
+        }
+    }
+    if (!patched_output) {
+        return;
+    }
+    if (!patched_output->IsOpen() || output_record.size() != cell_info.size()) {
+        WritePatchedOutput();
+        return;
+    }
+    auto patch = [&](int cell) {
+        patched_output->SetValue(output_record[cell], cell_info[cell]->value.load().value);
+    };
+    patched_output->BeginUpdate();
+    if (recalculated_cells.size() < kParallelLevelSize) {
+        std::for_each(std::begin(recalculated_cells), std::end(recalculated_cells), patch);
+    } else {
+        std::for_each(std::execution::par_unseq, std::begin(recalculated_cells), std::end(recalculated_cells), patch);
+    }
+    patched_output->EndUpdate();
+}
+
 // ----------------------------
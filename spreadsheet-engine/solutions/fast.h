@@ -1,7 +1,16 @@
 #ifndef SPREADSHEETENGINE_FAST_H
 #define SPREADSHEETENGINE_FAST_H
 
+#include <deque>
+#include <memory>
 #include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+  #include <future>
+#else
+  #include <sys/types.h>
+#endif
 
 #ifdef _WIN32
   #include <concurrent_vector.h>
@@ -16,6 +25,13 @@
 #endif
 
 #include "solution.h"
+#include "../cell-ids.h"
+#include "memo-cache.h"
+#include "snapshot.h"
+#include "fork.h"
+#include "../patched-output.h"
+#include "../async-file-io.h"
+#include "../epoch-reclaimer.h"
 #include "../lock-free-queue/blockingconcurrentqueue.h"
 
 // This solution based on bfs (breadth-first search) which is easy to parallelize.
@@ -51,8 +67,8 @@ private:
 
     struct CellInfo {
         CellInfo() = default;
-        CellInfo(const Formula& formula, const std::string& name) : 
-            formula(formula), value(CellValue(false, 0)), unresolved_cells_count(0), name(name), total_dependency_count(0) {}
+        CellInfo(Formula formula) :
+            formula(std::move(formula)), value(CellValue(false, 0)), unresolved_cells_count(0), total_dependency_count(0) {}
 
         std::mutex mutex;
 
@@ -60,7 +76,6 @@ private:
 
         Formula formula;
         std::atomic<int> unresolved_cells_count;
-        std::string name;
         std::atomic<int> total_dependency_count;
     };
     
@@ -72,29 +87,76 @@ private:
     // For each 'a' cell we store an array of nodes which are connected from 'a'.
     Concurrency::concurrent_vector<Edges> DAG;
 
-    Concurrency::concurrent_unordered_map<std::string, int> id_by_name;
-
     // Formula of these cells contains only numbers
     Concurrency::concurrent_vector<int> starting_cells;
 
     Concurrency::concurrent_vector<int> need_to_recalculate;
+
+    // Cells which are marked for recalculation with their old values, they are kept only if the journal is enabled.
+    Concurrency::concurrent_vector<std::pair<int, ValueType>> marked_values;
 #else
 
     // DAG is directed acyclic graph. Edge 'a' -> 'b' exists if and only if formula of 'b' contains 'a'.
     // For each 'a' cell we store an array of nodes which are connected from 'a'.
     tbb::concurrent_vector<Edges> DAG;
 
-    tbb::concurrent_unordered_map<std::string, int> id_by_name;
-
     // Formula of these cells contains only numbers
     tbb::concurrent_vector<int> starting_cells;
 
     tbb::concurrent_vector<int> need_to_recalculate;
+
+    // Cells which are marked for recalculation with their old values, they are kept only if the journal is enabled.
+    tbb::concurrent_vector<std::pair<int, ValueType>> marked_values;
 #endif
 
     
 
+    // nullptr for ids of deleted cells, they are kept in free_cells and are given to cells added later.
+    // free_cells is sorted in descending order, so the least free id is reused first and replay of the same
+    // deletions and additions after a load of a snapshot gives the same ids.
     std::vector<CellInfo*> cell_info;
+    std::vector<int> free_cells;
+    CellIds ids;
+
+    // Cells for ReadValue() from other threads. Slots are never moved, so the table can grow while it is read.
+    // Cells of the first published_count slots can be read. Deleted cells are retired to 'epochs'.
+    struct PublishedCell {
+        std::atomic<CellInfo*> info{nullptr};
+    };
+#ifdef _WIN32
+    Concurrency::concurrent_vector<PublishedCell> published_cells;
+#else
+    tbb::concurrent_vector<PublishedCell> published_cells;
+#endif
+    std::atomic<int> published_count{0};
+    EpochReclaimer epochs;
+
+    // Chain contraction: chain_next[a] = b if 'a' -> 'b' is the only edge going from 'a' and the only edge going into 'b'.
+    // Such chains don't have any parallelism, so the whole chain is evaluated by the thread which evaluated its head
+    // without pushing cells to the queue. -1 if there is no link.
+    std::vector<int> chain_next;
+
+    // Ids of cells in output order (column letter, then numeric row). The order is kept between writes:
+    // cells which are added later are sorted and merged into it, edits of formulas don't change it.
+    // Cells with ids less than ordered_ids_count are in the order. Deleted cells are removed from it and cells
+    // which reuse their ids are inserted by a binary search.
+    std::vector<int> output_order;
+    std::size_t ordered_ids_count = 0;
+
+    // Output file which is patched by every edit, nullptr if the mode is disabled.
+    // output_record[cell] is the record of the cell in the file, its position in output_order.
+    std::unique_ptr<PatchedOutputFile> patched_output;
+    std::string patched_output_path;
+    std::vector<int> output_record;
+
+    // Columnar export: values by id and cells which were recalculated by the last edit. They are kept only after
+    // the first GetValues() call and are updated by edits in place.
+    bool is_columnar_export_enabled = false;
+    std::vector<ValueType> dense_values;
+    std::vector<int> last_changed_cells;
+
+    // Asynchronous writes of output files and snapshots, it is created by the first of them.
+    std::unique_ptr<AsyncFileIO> async_io;
     
     moodycamel::BlockingConcurrentQueue<int> lock_free_queue;
     std::atomic<int> done_consumers;
@@ -103,34 +165,275 @@ private:
 
     std::atomic<int> calculated_cells_count = 0;
 
-    void BuildDAG(bool parallel, const InputData& input_data);
+    // Recalculation plan of a frequently edited cell: all cells reachable from it in topological order,
+    // split into levels. Cells of one level don't depend on each other, so a level can be evaluated in parallel.
+    // A plan stays valid while no structural edit (formula with different set of cell references) touches its cells.
+    struct RecalculationPlan {
+        std::vector<int> cells;
+        // Level i is cells[level_bounds[i]..level_bounds[i + 1]).
+        std::vector<int> level_bounds;
+        // The same cells sorted by id, used to check if a structural edit invalidates the plan.
+        std::vector<int> sorted_cells;
+        int last_used = 0;
+    };
+
+    static const int kHotEditCount = 2;
+    static const int kMaxCachedPlans = 32;
+    static const int kParallelLevelSize = 1024;
+    // Deleted edges of a cell are removed when there are at least so many of them and they are the majority.
+    static const int kMinCompactedEdges = 16;
+
+    std::unordered_map<int, RecalculationPlan> plans;
+    std::unordered_map<int, int> edit_count;
+    int plans_clock = 0;
+
+    // Undo/redo journal. An entry is an edit: formulas of edited cells before and after it and values of all cells
+    // which it recalculated. Undo and redo put formulas back (edges follow references of formulas) and store values
+    // without evaluation. Entries before journal_position can be undone, the rest of them can be redone.
+    struct JournalEntry {
+        std::vector<int> edited_cells;
+        std::vector<Formula> old_formulas;
+        std::vector<Formula> new_formulas;
+        std::vector<int> cells;
+        std::vector<ValueType> old_values;
+        std::vector<ValueType> new_values;
+        std::size_t bytes = 0;
+    };
+
+    // 0 if the journal is disabled.
+    std::size_t journal_budget = 0;
+    std::size_t journal_bytes = 0;
+    std::deque<JournalEntry> journal;
+    std::size_t journal_position = 0;
+
+    // Threads which evaluate cells during streaming load.
+    std::vector<std::thread> load_threads;
+    std::atomic<bool> is_load_aborted = false;
+
+    // Snapshot sections: formulas (CSR of addends), dependents (CSR of DAG edges), names, values and chain links.
+    enum SnapshotSection {
+        kFormulaOffsets, kAddends, kDependentOffsets, kDependents, kNameOffsets, kNames, kValues, kChainNext,
+        kSnapshotSectionsCount
+    };
+    static const uint32_t kSnapshotVersion = 1;
+
+    struct SnapshotData {
+        std::vector<uint64_t> formula_offsets;
+        std::vector<int32_t> addends;
+        std::vector<uint64_t> dependent_offsets;
+        std::vector<int32_t> dependents;
+        std::vector<uint64_t> name_offsets;
+        std::vector<char> names;
+        std::vector<int32_t> values;
+        std::vector<int32_t> chain_next;
+    };
+
+    // Snapshot which is written in background.
+#ifdef _WIN32
+    std::future<bool> background_snapshot;
+#else
+    pid_t background_snapshot = -1;
+#endif
+
+    // Base of forks, it is built by the first Fork() after a change of the solution. Every method which changes
+    // formulas or values resets it before the change.
+    std::shared_ptr<const ForkBase> fork_base;
+
+    // Results of expensive formulas, nullptr if memoization is disabled.
+    std::unique_ptr<MemoCache> memo_cache;
+
+    // 'Input' is const InputData whose formulas are copied to cells or InputData owned by the solution whose formulas
+    // are moved to cells.
+    template <typename Input>
+    void BuildDAG(bool parallel, Input& input_data);
     // For testing purpose
     void SequentialBuildDAG(const InputData& input_data);
     void ParallelBuildDAG(const InputData& input_data);
 
-    void RecalculateDAG(int cell, const Formula& formula);
+    template <typename Input>
+    void Initialize(Input& input_data);
+    // Frees cells of the previous workbook before a load, readers should not run then.
+    void FreeCells();
+    void CalculateInitialValues();
+    void RecalculateDAG(int cell, Formula formula);
+    // Returns true if the edit is value-only.
+    bool ReplaceFormula(int cell, Formula formula);
+    void UpdateChainLink(int cell);
+    void CompactEdges(int cell);
+    // References to unknown and deleted cells are replaced by reference errors.
+    void ResolveReferences(Formula& formula) const;
+    int EvaluateChainTail(int cell);
+    static bool HaveSameReferences(const Formula& a, const Formula& b);
+    // Formulas with this number of addends prefetch their precedents before loading them.
+    static const std::size_t kMinPrefetchFormulaSize = 8;
+    ValueType GetAddendValue(const Addend& addend) const;
     ValueType CalculateCellValue(int cell, const Formula& formula);
+    ValueType CalculateCellValueWithMemoization(const Formula& formula);
 
     void ParallelValuesCalculation();
     void InitialValuesCalculationThreadJob();
 
+    void StreamingCalculationThreadJob();
+    void AbortLoad();
+
+    void RecalculateCells(const std::vector<int>& changed_cells);
+    void RecalculateMarkedCells();
     void RecalculateCellsThreadJob();
     void FindRecalculationCellsThreadJob();
 
+    void BuildSnapshot(SnapshotData& data, bool parallel);
+    static void AddSnapshotSections(SnapshotWriter& writer, const SnapshotData& data);
+    static bool WriteSnapshot(const SnapshotData& data, const std::string& file_path, bool parallel);
+
+    std::shared_ptr<const ForkBase> BuildForkBase();
+
+    void ResetOutputOrder();
+    void UpdateOutputOrder();
+    std::size_t FindOutputRecord(int cell) const;
+    void InsertIntoOutputOrder(int cell);
+    void RemoveFromOutputOrder(int cell);
+    void PublishCells(int begin, int end);
+    ValueType GetCellValue(int cell) const;
+    std::vector<ValueType> GetValuesById();
+    AsyncFileIO& GetAsyncIO();
+    bool WritePatchedOutput();
+    void RebuildExports();
+    template <typename Cells>
+    void UpdateExports(const Cells& recalculated_cells);
+
+    template <typename Input>
+    bool AppendInputCells(Input& cells, std::string& error);
+
+    void TakeMarkedValues(JournalEntry& entry);
+    void AddJournalEntry(JournalEntry&& entry);
+    void ApplyJournalEntry(const JournalEntry& entry, bool undo);
+    void ResetJournal();
+
+    void BuildRecalculationPlan(int cell);
+    void InvalidateRecalculationPlans(int cell, const Formula& formula);
+    void EvaluateRecalculationPlan(const RecalculationPlan& plan);
+
 public:
 
     // Time complexity is O(n) where n - number of vertices in input_data.
     void InitialCalculate(const InputData& input_data) override;
+    // Formulas are moved to cells and the rest of the input is freed before values are calculated.
+    void InitialCalculate(InputData&& input_data) override;
 
     // Time complexity is O(t) where t - total number of cells which are depended on 'cell'.
     void ChangeCell(const std::string& cell, const Formula& formula) override;
+    void ChangeCell(const std::string& cell, Formula&& formula) override;
+    // Hot path for callers which keep ids of cells: there is no name lookup and the formula is not copied.
+    // Returns false if there is no cell with the id (e.g. it was deleted), the solution is not changed then.
+    bool ChangeCell(int cell, Formula&& formula);
+    // Returns -1 if there is no such cell.
+    int FindCell(std::string_view name) const { return ids.Find(name); }
+
+    // Adds the cell and evaluates it, the least id of a deleted cell is reused if there is one. Cells of the formula which
+    // don't exist are reference errors. Returns false if the cell already exists. ChangeCell() of an unknown cell adds it.
+    bool AddCell(std::string_view name, Formula formula);
+    // Deletes the cell. Its dependents get reference errors (the references are replaced in their formulas)
+    // and are recalculated. Returns false if there is no such cell.
+    bool DeleteCell(std::string_view name);
+    // Can be called from any thread while one thread edits the solution (ChangeCell, AddCell, DeleteCell, AppendCells),
+    // but not during loads. Returns false if there is no such cell or it is being recalculated.
+    // Memory of deleted cells is freed only when readers which could see them are done.
+    bool ReadValue(std::string_view name, ValueType& value);
+    // Numbers of live cells, of ids (live and free) and of deleted cells which are not freed yet.
+    std::size_t GetCellsCount() const { return cell_info.size() - free_cells.size(); }
+    std::size_t GetIdsCount() const { return cell_info.size(); }
+    std::size_t GetRetiredCellsCount() const { return epochs.GetRetiredCount(); }
+
+    // Applies edits in order, but recalculates every affected cell only once. Used to replay the edit log.
+    void ChangeCells(const InputData& edits);
+
+    // Adds new cells to the loaded ones without reloading. Ids of new cells should follow ids of loaded cells
+    // ([cells count, cells count + cells.size())), as the reader assigns them by the CellIds of the loaded input.
+    // Formulas can reference loaded and new cells. Loaded cells don't depend on new ones, so only new cells are evaluated.
+    // Time complexity is O(k log k) where k - number of new cells and references in their formulas.
+    // Returns false and doesn't change the solution if the cells are not valid.
+    bool AppendCells(const InputData& cells, std::string& error);
+    // Formulas are moved to cells.
+    bool AppendCells(InputData&& cells, std::string& error);
 
     OutputData GetCurrentValues() override;
 
+    // Ids of all cells sorted by CellIds::GetSortKey(). Cells with the same key (like "A1" and "A01") are ordered by id.
+    const std::vector<int>& GetOutputOrder();
+    // Writes the output file in the kept order, so only values are formatted. Returns the file size.
+    std::size_t WriteCurrentValues(const std::string& file_path);
+
+    // Output mode for consumers which follow a values file: the file of fixed-width records in output order
+    // is written once and kept mapped, then ChangeCell() and ChangeCells() rewrite records of recalculated cells only.
+    // The file is written again if cells are loaded or added.
+    bool EnablePatchedOutput(const std::string& file_path);
+
+    // The same as WriteCurrentValues() and SaveSnapshot(), but only formatting and copying of the state are done
+    // before return. Files are written by io_uring (or a thread pool) while the solution serves next edits.
+    // WaitAsyncWrites() waits for all of them and returns false if any of them failed.
+    void WriteCurrentValuesAsync(const std::string& file_path);
+    void SaveSnapshotAsync(const std::string& file_path);
+    bool WaitAsyncWrites();
+
+    // Columnar export without allocations per cell. Values are indexed by id of the cell, the view stays valid and
+    // is updated in place by edits (only recalculated cells are written) until cells are loaded or added.
+    // The first call copies all values.
+    Span<ValueType> GetValues();
+    // Cells which were recalculated by the last ChangeCell() or ChangeCells(), they are indices of GetValues().
+    Span<int> GetLastChangedCells();
+    // Dictionary of ids: name of cell 'id' is names[offsets[id]..offsets[id + 1]). Edits don't change it,
+    // so consumers need it only once.
+    void GetNames(std::vector<uint64_t>& offsets, std::vector<char>& names);
+    // Writes the binary columnar file, see ColumnarExport.
+    bool ExportValues(const std::string& file_path, bool with_names, bool with_changed_cells);
+    const PatchedOutputFile* GetPatchedOutput() const { return patched_output.get(); }
+
+    // Streaming load, an alternative to InitialCalculate(). Cells are evaluated while the rest of them are being loaded:
+    // a cell is evaluated as soon as it is loaded and all cells in its formula are evaluated.
+    // LoadCell() should be called once for every id in [0, cells_count), it takes formula of the cell.
+    // EndLoad() waits until all cells are evaluated.
+    void BeginLoad(int cells_count);
+    void LoadCell(InputCellInfo& cell);
+    void EndLoad();
+
+    // Binary snapshot of the current state. Loaded solution serves ChangeCell() at once: the file is mapped,
+    // there is no parsing and no recalculation. LoadSnapshot() returns false if the file is not a valid snapshot,
+    // the solution is not changed unless two cells of the snapshot have the same name.
+    bool SaveSnapshot(const std::string& file_path);
+    bool LoadSnapshot(const std::string& file_path, std::string& error);
+
+    // Writes the snapshot of the current state while the solution keeps serving ChangeCell(). On POSIX the process
+    // is forked and the child writes its frozen copy-on-write image. WaitBackgroundSnapshot() returns true
+    // if the snapshot was written. Only one background snapshot can be in progress, it isn't started during a load.
+    bool StartBackgroundSnapshot(const std::string& file_path);
+    bool WaitBackgroundSnapshot();
+
+    // Undo and redo of ChangeCell() and ChangeCells() in time proportional to the number of cells changed by the edit,
+    // without evaluation. The oldest entries are evicted to keep the journal within 'memory_budget' bytes.
+    // Other changes clear the journal: loads, AddCell, DeleteCell and AppendCells, also ChangeCell() and ChangeCells()
+    // of an unknown cell, since they add it. Ids of deleted and added cells are reused, so entries before such
+    // a change could put formulas to other cells. Undo() and Redo() return false if there is nothing to undo or redo.
+    void EnableJournal(std::size_t memory_budget);
+    bool Undo();
+    bool Redo();
+    std::size_t GetJournalBytes() const { return journal_bytes; }
+
+    // Copy-on-write fork for what-if edits, see SolutionFork. The first fork after a change of the solution
+    // freezes its state in O(n), next ones copy only the table of value pages. Forks don't see later changes
+    // of the solution.
+    SolutionFork Fork();
+    // Frozen state of the solution which is shared by forks and ScenarioSolution.
+    std::shared_ptr<const ForkBase> GetForkBase();
+
+    // Cells which see the same values of formula cells as before are not recalculated, the result is taken
+    // from the cache of 'capacity' entries. It makes sense only if sum() is expensive.
+    void EnableMemoization(std::size_t capacity);
+    MemoCache* GetMemoCache() { return memo_cache.get(); }
+
     ~FastSolution() {
-        for (const auto& it : cell_info) {
-            delete it;
-        }
+        AbortLoad();
+        WaitBackgroundSnapshot();
+        FreeCells();
         cell_info.clear();
     }
 };
@@ -0,0 +1,133 @@
+#include <algorithm>
+
+#include "fork.h"
+#include "solution.h"
+
+SolutionFork::SolutionFork(std::shared_ptr<const ForkBase> base)
+    : base(base), value_pages(base->value_pages), owned_pages(base->value_pages.size(), false) {}
+
+// Pages of both forks are shared now, so neither of them writes to them in place.
+SolutionFork SolutionFork::Fork() {
+    owned_pages.assign(owned_pages.size(), false);
+    return *this;
+}
+
+void SolutionFork::GetFormula(int cell, const Addend*& begin, const Addend*& end) const {
+    auto it = formulas.find(cell);
+    if (it != formulas.end()) {
+        begin = it->second.data();
+        end = begin + it->second.size();
+        return;
+    }
+    begin = base->addends.data() + base->formula_offsets[cell];
+    end = base->addends.data() + base->formula_offsets[cell + 1];
+}
+
+bool SolutionFork::References(int cell, int precedent) const {
+    const Addend* begin;
+    const Addend* end;
+    GetFormula(cell, begin, end);
+    return std::any_of(begin, end, [&](const Addend& it) { return it.type == Addend::CELL && it.value == precedent; });
+}
+
+// Edges of the base whose dependent doesn't reference the cell any more are skipped. An edge can be visited twice
+// (the formula references the cell twice, or the edge was removed and added again), but every pass visits
+// the same edges, so counts of unresolved precedents are consistent.
+template <typename Visitor>
+void SolutionFork::ForEachDependent(int cell, const Visitor& visit) const {
+    for (uint64_t i = base->dependent_offsets[cell]; i < base->dependent_offsets[cell + 1]; i++) {
+        int dependent = base->dependents[i];
+        if (formulas.empty() || References(dependent, cell)) {
+            visit(dependent);
+        }
+    }
+    auto added = added_dependents.find(cell);
+    if (added != added_dependents.end()) {
+        for (int dependent : added->second) {
+            if (References(dependent, cell)) {
+                visit(dependent);
+            }
+        }
+    }
+}
+
+void SolutionFork::SetValue(int cell, ValueType value) {
+    std::size_t index = cell >> ForkBase::kPageBits;
+    auto& page = value_pages[index];
+    if (!owned_pages[index]) {
+        page = std::make_shared<ForkBase::ValuePage>(*page);
+        owned_pages[index] = true;
+    }
+    (*page)[cell & (ForkBase::kPageSize - 1)] = value;
+}
+
+void SolutionFork::ChangeCell(int cell, Formula formula) {
+    int cells_count = base->cells_count;
+    for (auto& it : formula) {
+        if (it.type == Addend::CELL && (it.value < 0 || it.value >= cells_count)) {
+            it = Addend(Addend::VALUE, kReferenceError);
+        }
+    }
+    for (const auto& it : formula) {
+        if (it.type == Addend::CELL && !References(cell, it.value)) {
+            auto& added = added_dependents[it.value];
+            if (std::find(added.begin(), added.end(), cell) == added.end()) {
+                added.push_back(cell);
+            }
+        }
+    }
+    formulas[cell] = std::move(formula);
+
+    // Kahn's algorithm on cells reachable from the changed one: only they are visited.
+    std::unordered_map<int, int> unresolved;
+    std::vector<int> reachable = { cell };
+    unresolved[cell] = 0;
+    for (std::size_t i = 0; i < reachable.size(); i++) {
+        ForEachDependent(reachable[i], [&](int next) {
+            auto it = unresolved.try_emplace(next, 0);
+            if (it.second) {
+                reachable.push_back(next);
+            }
+            it.first->second++;
+        });
+    }
+
+    std::vector<int> ready = { cell };
+    while (!ready.empty()) {
+        int current = ready.back();
+        ready.pop_back();
+        const Addend* begin;
+        const Addend* end;
+        GetFormula(current, begin, end);
+        SumType value = 0;
+        for (const Addend* it = begin; it != end; it++) {
+            value = sum(value, it->type == Addend::CELL ? GetValue(it->value) : it->value);
+        }
+        SetValue(current, SumValue(value));
+        ForEachDependent(current, [&](int next) {
+            if (--unresolved[next] == 0) {
+                ready.push_back(next);
+            }
+        });
+    }
+}
+
+std::size_t SolutionFork::GetOwnedPagesCount() const {
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < value_pages.size(); i++) {
+        count += value_pages[i] != base->value_pages[i];
+    }
+    return count;
+}
+
+std::size_t SolutionFork::GetOwnedBytes() const {
+    std::size_t bytes = sizeof(SolutionFork) + value_pages.size() * sizeof(value_pages[0]) +
+        GetOwnedPagesCount() * sizeof(ForkBase::ValuePage);
+    for (const auto& it : formulas) {
+        bytes += sizeof(it) + it.second.size() * sizeof(Addend);
+    }
+    for (const auto& it : added_dependents) {
+        bytes += sizeof(it) + it.second.size() * sizeof(int);
+    }
+    return bytes;
+}
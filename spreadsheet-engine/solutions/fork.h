@@ -0,0 +1,70 @@
+#ifndef SPREADSHEETENGINE_FORK_H
+#define SPREADSHEETENGINE_FORK_H
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "../io-data.h"
+
+// Frozen state of FastSolution which is shared by its forks: formulas and dependents as CSR arrays, values in pages.
+// Deleted cells have empty formulas, no dependents and reference error values.
+struct ForkBase {
+    // Pages of 1024 values: edits usually touch cells scattered over the workbook, larger pages are copied
+    // for a few changed values.
+    static const int kPageBits = 10;
+    static const int kPageSize = 1 << kPageBits;
+    using ValuePage = std::array<ValueType, kPageSize>;
+
+    std::size_t cells_count = 0;
+    std::vector<uint64_t> formula_offsets;
+    std::vector<Addend> addends;
+    std::vector<uint64_t> dependent_offsets;
+    std::vector<int> dependents;
+    std::vector<std::shared_ptr<ValuePage>> value_pages;
+};
+
+// Copy-on-write fork of FastSolution for what-if scenarios. A fork shares the base and all value pages which
+// it didn't change; a page is copied by the first write of the fork to it. Only pages which the fork copied itself
+// are written in place, shared pages are never changed, so forks can be edited in parallel. Edited formulas and new edges are kept
+// by the fork, an edge of the base is ignored if the current formula of its dependent doesn't reference its cell.
+// So ChangeCell() costs only the cells it recalculates and pages they are on.
+//
+// Cells are identified by ids of the forked solution. Forks don't share mutable state, so different forks can be
+// edited in parallel. A fork is evaluated in one thread.
+class SolutionFork {
+public:
+    explicit SolutionFork(std::shared_ptr<const ForkBase> base);
+
+    // Fork of the fork: value pages are shared by both of them until one of them writes to a page.
+    SolutionFork Fork();
+
+    // References to cells which don't exist are reference errors.
+    void ChangeCell(int cell, Formula formula);
+    ValueType GetValue(int cell) const { return (*value_pages[cell >> ForkBase::kPageBits])[cell & (ForkBase::kPageSize - 1)]; }
+
+    std::size_t GetCellsCount() const { return base->cells_count; }
+    // Pages which are not shared with the base.
+    std::size_t GetOwnedPagesCount() const;
+    // Memory which the fork doesn't share with other forks, approximately.
+    std::size_t GetOwnedBytes() const;
+
+private:
+    std::shared_ptr<const ForkBase> base;
+    std::vector<std::shared_ptr<ForkBase::ValuePage>> value_pages;
+    // Pages which were copied by this fork and are not shared with other forks.
+    std::vector<bool> owned_pages;
+    std::unordered_map<int, Formula> formulas;
+    std::unordered_map<int, std::vector<int>> added_dependents;
+
+    void SetValue(int cell, ValueType value);
+    // Formula of the cell as [begin, end).
+    void GetFormula(int cell, const Addend*& begin, const Addend*& end) const;
+    bool References(int cell, int precedent) const;
+    template <typename Visitor>
+    void ForEachDependent(int cell, const Visitor& visit) const;
+};
+
+#endif //SPREADSHEETENGINE_FORK_H
@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(_M_X64)
+  #define FORMULA_KERNELS_X86
+  #include <immintrin.h>
+  #ifdef _WIN32
+    #include <intrin.h>
+    #define TARGET(features)
+  #else
+    #define TARGET(features) __attribute__((target(features)))
+  #endif
+#endif
+
+#include "formula-kernels.h"
+#include "solution.h"
+
+// Vector kernels read addends as pairs (type, value) of 32-bit integers.
+static_assert(sizeof(Addend) == 2 * sizeof(int32_t), "addend is not a pair of 32-bit integers");
+
+ValueType SumFormulaScalar(const Addend* begin, const Addend* end, const ValueType* values) {
+    SumType value = 0;
+    for (const Addend* it = begin; it != end; it++) {
+        value = sum(value, it->type == Addend::CELL ? values[it->value] : it->value);
+    }
+    return SumValue(value);
+}
+
+// The same as sum() in every lane without branches: partial sums wrap around as 32-bit integers and errors
+// are kept apart, so the result doesn't depend on the order of addends either. Then it is mapped as by SumValue().
+template <int K>
+static void SumLanesScalar(const Addend* begin, const Addend* end, const ValueType* values, ValueType* result) {
+    ValueType sums[K] = {};
+    ValueType errors[K] = {};
+    for (const Addend* it = begin; it != end; it++) {
+        const ValueType* lanes = values + (std::size_t) it->value * K;
+        for (int lane = 0; lane < K; lane++) {
+            ValueType addend = it->type == Addend::CELL ? lanes[lane] : it->value;
+            errors[lane] |= addend == kReferenceError;
+            sums[lane] = ValueType(unsigned(sums[lane]) + unsigned(addend));
+        }
+    }
+    for (int lane = 0; lane < K; lane++) {
+        ValueType value = sums[lane] == kReferenceError ? kMinValue : sums[lane];
+        result[lane] = errors[lane] != 0 ? kReferenceError : value;
+    }
+}
+
+static SumLanesKernel GetSumLanesScalar(int lanes_count) {
+    switch (lanes_count) {
+    case 1:
+        return { "scalar", SumLanesScalar<1> };
+    case 2:
+        return { "scalar", SumLanesScalar<2> };
+    case 4:
+        return { "scalar", SumLanesScalar<4> };
+    case 8:
+        return { "scalar", SumLanesScalar<8> };
+    default:
+        return { "scalar", SumLanesScalar<16> };
+    }
+}
+
+#ifdef FORMULA_KERNELS_X86
+
+// 8 addends are two vectors of (type, value) pairs: they are split into a vector of types and a vector of values,
+// values of cells are replaced by gathered ones. Pairs after the end of the formula are not loaded.
+TARGET("avx2")
+ValueType SumFormulaAvx2(const Addend* begin, const Addend* end, const ValueType* values) {
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i deinterleave = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    const __m256i cell_type = _mm256_set1_epi32(Addend::CELL);
+    const __m256i reference_error = _mm256_set1_epi32(kReferenceError);
+    __m256i result = _mm256_setzero_si256();
+    __m256i errors = _mm256_setzero_si256();
+    for (; begin < end; begin += 8) {
+        int count = int(std::min<std::ptrdiff_t>(end - begin, 8));
+        const int* data = reinterpret_cast<const int*>(begin);
+        __m256i low, high;
+        if (count == 8) {
+            low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+            high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 8));
+        } else {
+            __m256i ints = _mm256_set1_epi32(2 * count);
+            low = _mm256_maskload_epi32(data, _mm256_cmpgt_epi32(ints, lanes));
+            high = _mm256_maskload_epi32(data + 8, _mm256_cmpgt_epi32(ints, _mm256_add_epi32(lanes, _mm256_set1_epi32(8))));
+        }
+        low = _mm256_permutevar8x32_epi32(low, deinterleave);
+        high = _mm256_permutevar8x32_epi32(high, deinterleave);
+        __m256i types = _mm256_permute2x128_si256(low, high, 0x20);
+        __m256i addends = _mm256_permute2x128_si256(low, high, 0x31);
+        __m256i is_cell = _mm256_and_si256(_mm256_cmpeq_epi32(types, cell_type),
+            _mm256_cmpgt_epi32(_mm256_set1_epi32(count), lanes));
+        addends = _mm256_mask_i32gather_epi32(addends, values, addends, is_cell, sizeof(ValueType));
+        errors = _mm256_or_si256(errors, _mm256_cmpeq_epi32(addends, reference_error));
+        result = _mm256_add_epi32(result, addends);
+    }
+    if (!_mm256_testz_si256(errors, errors)) {
+        return kReferenceError;
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(result), _mm256_extracti128_si256(result, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+    ValueType value = _mm_cvtsi128_si32(half);
+    return value == kReferenceError ? kMinValue : value;
+}
+
+// The same for 16 addends, the tail is loaded and gathered by masks.
+TARGET("avx512f")
+ValueType SumFormulaAvx512(const Addend* begin, const Addend* end, const ValueType* values) {
+    const __m512i types_index = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+    const __m512i values_index = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+    const __m512i cell_type = _mm512_set1_epi32(Addend::CELL);
+    const __m512i reference_error = _mm512_set1_epi32(kReferenceError);
+    __m512i result = _mm512_setzero_si512();
+    __mmask16 errors = 0;
+    for (; begin < end; begin += 16) {
+        int count = int(std::min<std::ptrdiff_t>(end - begin, 16));
+        const int* data = reinterpret_cast<const int*>(begin);
+        __mmask16 valid = __mmask16((1u << count) - 1);
+        __mmask16 low_mask = count >= 8 ? __mmask16(0xFFFF) : __mmask16((1u << (2 * count)) - 1);
+        __mmask16 high_mask = count <= 8 ? __mmask16(0) : __mmask16((1u << (2 * count - 16)) - 1);
+        __m512i low = _mm512_maskz_loadu_epi32(low_mask, data);
+        __m512i high = _mm512_maskz_loadu_epi32(high_mask, data + 16);
+        __m512i types = _mm512_permutex2var_epi32(low, types_index, high);
+        __m512i addends = _mm512_permutex2var_epi32(low, values_index, high);
+        __mmask16 is_cell = _mm512_mask_cmpeq_epi32_mask(valid, types, cell_type);
+        addends = _mm512_mask_i32gather_epi32(addends, is_cell, addends, values, sizeof(ValueType));
+        errors |= _mm512_cmpeq_epi32_mask(addends, reference_error);
+        result = _mm512_add_epi32(result, addends);
+    }
+    if (errors != 0) {
+        return kReferenceError;
+    }
+    // Halves are added as in the AVX2 kernel. They are taken through memory: _mm512_reduce_add_epi32() and
+    // 512-to-256-bit casts and extracts give false maybe-uninitialized warnings in GCC 12.
+    alignas(64) ValueType lanes[16];
+    _mm512_store_si512(lanes, result);
+    __m256i quarter = _mm256_add_epi32(_mm256_load_si256(reinterpret_cast<const __m256i*>(lanes)),
+        _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes + 8)));
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(quarter), _mm256_extracti128_si256(quarter, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+    ValueType value = _mm_cvtsi128_si32(half);
+    return value == kReferenceError ? kMinValue : value;
+}
+
+// The OS should save AVX (and AVX-512) registers, it is checked by XGETBV on Windows. GCC and Clang check it
+// in __builtin_cpu_supports().
+static bool SupportsAvx2() {
+#ifdef _WIN32
+    int info[4];
+    __cpuid(info, 1);
+    bool os_saves_avx = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+    __cpuidex(info, 7, 0);
+    return os_saves_avx && (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static bool SupportsAvx512() {
+#ifdef _WIN32
+    int info[4];
+    __cpuid(info, 1);
+    bool os_saves_avx512 = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0xE6) == 0xE6;
+    __cpuidex(info, 7, 0);
+    return os_saves_avx512 && (info[1] & (1 << 16)) != 0;
+#else
+    return __builtin_cpu_supports("avx512f");
+#endif
+}
+
+// Lane kernels keep K = 4 * V (SSE2), 8 * V (AVX2) or 16 (AVX-512) lanes in registers. SSE2 is a part of x86-64,
+// so it doesn't need a target.
+template <int V>
+static void SumLanesSse2(const Addend* begin, const Addend* end, const ValueType* values, ValueType* result) {
+    const __m128i reference_error = _mm_set1_epi32(kReferenceError);
+    const __m128i min_value = _mm_set1_epi32(kMinValue);
+    __m128i sums[V];
+    __m128i errors[V];
+    for (int v = 0; v < V; v++) {
+        sums[v] = _mm_setzero_si128();
+        errors[v] = _mm_setzero_si128();
+    }
+    for (const Addend* it = begin; it != end; it++) {
+        const __m128i* lanes = reinterpret_cast<const __m128i*>(values + (std::size_t) it->value * 4 * V);
+        __m128i constant = _mm_set1_epi32(it->value);
+        for (int v = 0; v < V; v++) {
+            __m128i addend = it->type == Addend::CELL ? _mm_load_si128(lanes + v) : constant;
+            errors[v] = _mm_or_si128(errors[v], _mm_cmpeq_epi32(addend, reference_error));
+            sums[v] = _mm_add_epi32(sums[v], addend);
+        }
+    }
+    for (int v = 0; v < V; v++) {
+        __m128i wrapped = _mm_cmpeq_epi32(sums[v], reference_error);
+        __m128i value = _mm_or_si128(_mm_andnot_si128(wrapped, sums[v]), _mm_and_si128(wrapped, min_value));
+        value = _mm_or_si128(_mm_andnot_si128(errors[v], value), _mm_and_si128(errors[v], reference_error));
+        _mm_store_si128(reinterpret_cast<__m128i*>(result) + v, value);
+    }
+}
+
+template <int V>
+TARGET("avx2")
+static void SumLanesAvx2(const Addend* begin, const Addend* end, const ValueType* values, ValueType* result) {
+    const __m256i reference_error = _mm256_set1_epi32(kReferenceError);
+    const __m256i min_value = _mm256_set1_epi32(kMinValue);
+    __m256i sums[V];
+    __m256i errors[V];
+    for (int v = 0; v < V; v++) {
+        sums[v] = _mm256_setzero_si256();
+        errors[v] = _mm256_setzero_si256();
+    }
+    for (const Addend* it = begin; it != end; it++) {
+        const __m256i* lanes = reinterpret_cast<const __m256i*>(values + (std::size_t) it->value * 8 * V);
+        __m256i constant = _mm256_set1_epi32(it->value);
+        for (int v = 0; v < V; v++) {
+            __m256i addend = it->type == Addend::CELL ? _mm256_load_si256(lanes + v) : constant;
+            errors[v] = _mm256_or_si256(errors[v], _mm256_cmpeq_epi32(addend, reference_error));
+            sums[v] = _mm256_add_epi32(sums[v], addend);
+        }
+    }
+    for (int v = 0; v < V; v++) {
+        __m256i value = _mm256_blendv_epi8(sums[v], min_value, _mm256_cmpeq_epi32(sums[v], reference_error));
+        value = _mm256_blendv_epi8(value, reference_error, errors[v]);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(result) + v, value);
+    }
+}
+
+TARGET("avx512f")
+static void SumLanesAvx512(const Addend* begin, const Addend* end, const ValueType* values, ValueType* result) {
+    const __m512i reference_error = _mm512_set1_epi32(kReferenceError);
+    __m512i sums = _mm512_setzero_si512();
+    __mmask16 errors = 0;
+    for (const Addend* it = begin; it != end; it++) {
+        __m512i addend = it->type == Addend::CELL ? _mm512_load_si512(values + (std::size_t) it->value * 16)
+                                                   : _mm512_set1_epi32(it->value);
+        errors |= _mm512_cmpeq_epi32_mask(addend, reference_error);
+        sums = _mm512_add_epi32(sums, addend);
+    }
+    sums = _mm512_mask_mov_epi32(sums, _mm512_cmpeq_epi32_mask(sums, reference_error), _mm512_set1_epi32(kMinValue));
+    sums = _mm512_mask_mov_epi32(sums, errors, reference_error);
+    _mm512_store_si512(result, sums);
+}
+
+std::vector<SumLanesKernel> GetSumLanesKernels(int lanes_count) {
+    std::vector<SumLanesKernel> kernels;
+    if (lanes_count == 16 && SupportsAvx512()) {
+        kernels.push_back({ "AVX-512", SumLanesAvx512 });
+    }
+    if (lanes_count == 16 && SupportsAvx2()) {
+        kernels.push_back({ "AVX2", SumLanesAvx2<2> });
+    } else if (lanes_count == 8 && SupportsAvx2()) {
+        kernels.push_back({ "AVX2", SumLanesAvx2<1> });
+    }
+    if (lanes_count == 16) {
+        kernels.push_back({ "SSE2", SumLanesSse2<4> });
+    } else if (lanes_count == 8) {
+        kernels.push_back({ "SSE2", SumLanesSse2<2> });
+    } else if (lanes_count == 4) {
+        kernels.push_back({ "SSE2", SumLanesSse2<1> });
+    }
+    kernels.push_back(GetSumLanesScalar(lanes_count));
+    return kernels;
+}
+
+#else
+
+// Vector kernels are never selected on other CPUs.
+ValueType SumFormulaAvx2(const Addend* begin, const Addend* end, const ValueType* values) {
+    return SumFormulaScalar(begin, end, values);
+}
+
+ValueType SumFormulaAvx512(const Addend* begin, const Addend* end, const ValueType* values) {
+    return SumFormulaScalar(begin, end, values);
+}
+
+static bool SupportsAvx2() { return false; }
+static bool SupportsAvx512() { return false; }
+
+std::vector<SumLanesKernel> GetSumLanesKernels(int lanes_count) {
+    return { GetSumLanesScalar(lanes_count) };
+}
+
+#endif
+
+std::vector<SumFormulaKernel> GetSumFormulaKernels() {
+    std::vector<SumFormulaKernel> kernels;
+    if (SupportsAvx512()) {
+        kernels.push_back({ "AVX-512", SumFormulaAvx512 });
+    }
+    if (SupportsAvx2()) {
+        kernels.push_back({ "AVX2", SumFormulaAvx2 });
+    }
+    kernels.push_back({ "scalar", SumFormulaScalar });
+    return kernels;
+}
+
+const SumFormulaKernel& GetSumFormulaKernel(std::size_t size) {
+    static const SumFormulaKernel scalar = { "scalar", SumFormulaScalar };
+    static const SumFormulaKernel narrow = SupportsAvx2() ? SumFormulaKernel{ "AVX2", SumFormulaAvx2 } : scalar;
+    static const SumFormulaKernel wide = SupportsAvx512() ? SumFormulaKernel{ "AVX-512", SumFormulaAvx512 } : narrow;
+    if (size < kMinVectorFormulaSize) {
+        return scalar;
+    }
+    return size < kMinAvx512FormulaSize ? narrow : wide;
+}
+
+SumLanesKernel GetSumLanesKernel(int lanes_count) {
+    static const std::vector<SumLanesKernel> kernels[] = { GetSumLanesKernels(1), GetSumLanesKernels(2), GetSumLanesKernels(4),
+                                                           GetSumLanesKernels(8), GetSumLanesKernels(16) };
+    int index = 0;
+    while ((1 << index) < lanes_count) {
+        index++;
+    }
+    return kernels[index].front();
+}
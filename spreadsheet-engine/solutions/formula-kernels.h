@@ -0,0 +1,72 @@
+#ifndef SPREADSHEETENGINE_FORMULA_KERNELS_H
+#define SPREADSHEETENGINE_FORMULA_KERNELS_H
+
+#include <cstddef>
+#include <vector>
+
+#include "../io-data.h"
+
+// Kernels which evaluate a formula over a dense array of values: the result is sum() of addends, a cell addend
+// is values[id]. Vector kernels read 8 or 16 addends at once, gather values of cells by the mask of cell addends
+// and reduce them in registers, a reference error is found by comparison of all gathered lanes.
+// They add addends in another order and wrap partial sums around, but errors are kept apart and the result
+// is mapped as by SumValue(), so they agree with a chain of sum() calls.
+using SumFormulaFunction = ValueType (*)(const Addend* begin, const Addend* end, const ValueType* values);
+
+ValueType SumFormulaScalar(const Addend* begin, const Addend* end, const ValueType* values);
+// Vector kernels can be called only if the CPU supports them, see GetSumFormulaKernels().
+ValueType SumFormulaAvx2(const Addend* begin, const Addend* end, const ValueType* values);
+ValueType SumFormulaAvx512(const Addend* begin, const Addend* end, const ValueType* values);
+
+struct SumFormulaKernel {
+    const char* name;
+    SumFormulaFunction function;
+};
+
+// Kernels are chosen by the size of the formula, limits are taken from the microbenchmark in engine.cpp
+// (random formulas over 300K generated values, ns per cell, GCC 12 -O2 on a CPU with AVX-512):
+//   addends  scalar  AVX2  AVX-512
+//   2        4.8     6.9   7.4
+//   4        11.7    6.9   7.5
+//   8        26.5    8.8   8.3
+//   12       41.8    13.5  11.9
+//   16       58.1    14.5  12.9
+//   32       116.4   27.2  26.1
+// Vector loads and gathers don't pay off for formulas shorter than kMinVectorFormulaSize. AVX-512 doesn't beat
+// AVX2 while the formula fits one AVX2 vector, so formulas up to 8 addends go to AVX2 if it is supported.
+const int kMinVectorFormulaSize = 4;
+const int kMinAvx512FormulaSize = 9;
+
+// Kernels which the CPU supports, wider ones are first. The scalar kernel is always supported.
+std::vector<SumFormulaKernel> GetSumFormulaKernels();
+// Kernel for formulas of 'size' addends on this CPU, CPU features are checked once.
+const SumFormulaKernel& GetSumFormulaKernel(std::size_t size);
+
+inline ValueType SumFormula(const Addend* begin, const Addend* end, const ValueType* values) {
+    return GetSumFormulaKernel(end - begin).function(begin, end, values);
+}
+
+// Kernels which evaluate a formula in K scenarios at once (ScenarioSolution). A cell has K values in a row which
+// are aligned to K values, so values of cell c start at values[c * K]; K values of the result go to 'result'.
+// Every lane is evaluated as by SumFormulaScalar(). Vector kernels keep the K lanes in one or two registers
+// (SSE2, AVX2 or AVX-512, functions are compiled for these targets and chosen at run time), a value addend
+// is broadcast to all lanes, and the error of a lane is found by comparison instead of a branch.
+using SumLanesFunction = void (*)(const Addend* begin, const Addend* end, const ValueType* values, ValueType* result);
+
+struct SumLanesKernel {
+    const char* name;
+    SumLanesFunction function;
+};
+
+// Kernels for K lanes (a power of 2 up to 16) which the CPU supports, wider ones are first. The scalar loop
+// is always supported. On the cbig test 16 scenarios take (ms, GCC 12 -O2 on a CPU with AVX-512, one lane takes 99 ms):
+//   lanes  scalar  SSE2  AVX2  AVX-512
+//   4      33      25    -     -
+//   8      24      13    13    -
+//   16     15      10    7     6
+// GCC 12 vectorizes the scalar loop for SSE2 at -O2 partly, GCC 9 (build.sh) doesn't vectorize at -O2 at all.
+std::vector<SumLanesKernel> GetSumLanesKernels(int lanes_count);
+// The first of them, CPU features are checked once.
+SumLanesKernel GetSumLanesKernel(int lanes_count);
+
+#endif //SPREADSHEETENGINE_FORMULA_KERNELS_H
@@ -0,0 +1,97 @@
+#include <algorithm>
+
+#include "memo-cache.h"
+
+// -------------- Key --------------
+
+// Two independent mixes (splitmix64 finalizer with different multipliers), so a false hit
+// needs a collision of both 64-bit halves.
+void MemoCache::KeyBuilder::Add(uint64_t x) {
+    uint64_t h = key.hash ^ x;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    key.hash = h ^ (h >> 31);
+
+    uint64_t c = key.check + x;
+    c = (c ^ (c >> 33)) * 0xff51afd7ed558ccdull;
+    c = (c ^ (c >> 33)) * 0xc4ceb9fe1a85ec53ull;
+    key.check = c ^ (c >> 33);
+}
+
+void MemoCache::KeyBuilder::AddCell(int cell, ValueType value) {
+    Add((uint64_t(1) << 63) | (uint64_t(uint32_t(cell)) << 32) | uint32_t(value));
+}
+
+void MemoCache::KeyBuilder::AddValue(ValueType value) {
+    Add(uint32_t(value));
+}
+
+// -------------- Cache --------------
+
+MemoCache::MemoCache(std::size_t capacity) : stripe_capacity(std::max<std::size_t>(1, capacity / kStripesCount)) {}
+
+bool MemoCache::Find(const Key& key, ValueType& value) {
+    Stripe& stripe = GetStripe(key);
+    {
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        auto it = stripe.index.find(key);
+        if (it != stripe.index.end()) {
+            Entry& entry = stripe.entries[it->second];
+            entry.is_referenced = true;
+            value = entry.value;
+            hits_count.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    misses_count.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void MemoCache::Insert(const Key& key, ValueType value) {
+    Stripe& stripe = GetStripe(key);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+
+    auto it = stripe.index.find(key);
+    if (it != stripe.index.end()) {
+        stripe.entries[it->second].value = value;
+        return;
+    }
+
+    if (stripe.entries.size() < stripe_capacity) {
+        stripe.index[key] = stripe.entries.size();
+        stripe.entries.push_back({ key, value, false });
+        return;
+    }
+
+    // CLOCK: referenced entries get the second chance.
+    while (stripe.entries[stripe.clock_hand].is_referenced) {
+        stripe.entries[stripe.clock_hand].is_referenced = false;
+        stripe.clock_hand = (stripe.clock_hand + 1) % stripe_capacity;
+    }
+    Entry& victim = stripe.entries[stripe.clock_hand];
+    stripe.index.erase(victim.key);
+    victim = { key, value, false };
+    stripe.index[key] = stripe.clock_hand;
+    stripe.clock_hand = (stripe.clock_hand + 1) % stripe_capacity;
+}
+
+std::size_t MemoCache::GetSize() {
+    std::size_t size = 0;
+    for (auto& stripe : stripes) {
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        size += stripe.entries.size();
+    }
+    return size;
+}
+
+std::size_t MemoCache::GetMemoryUsage() {
+    // Node of unordered_map stores the pair, a hash and a pointer to the next node.
+    const std::size_t node_size = sizeof(std::pair<const Key, int>) + 2 * sizeof(void*);
+    std::size_t memory = sizeof(MemoCache);
+    for (auto& stripe : stripes) {
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        memory += stripe.entries.capacity() * sizeof(Entry);
+        memory += stripe.index.size() * node_size + stripe.index.bucket_count() * sizeof(void*);
+    }
+    return memory;
+}
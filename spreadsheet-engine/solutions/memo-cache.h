@@ -0,0 +1,85 @@
+#ifndef SPREADSHEETENGINE_MEMO_CACHE_H
+#define SPREADSHEETENGINE_MEMO_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "../io-data.h"
+
+// Bounded cache of formula results. Formulas are pure, so the result is defined by the formula
+// and values of its cells. Key is 128-bit fingerprint of (formula, values of cells in formula).
+//
+// The table is split into stripes with own mutex, so threads which calculate different cells rarely wait
+// for each other. When a stripe is full, an entry is evicted by CLOCK algorithm (second chance).
+class MemoCache {
+public:
+    struct Key {
+        uint64_t hash;
+        uint64_t check;
+
+        bool operator==(const Key& other) const {
+            return hash == other.hash && check == other.check;
+        }
+    };
+
+    // Incrementally builds the key from formula addends.
+    class KeyBuilder {
+    public:
+        void AddCell(int cell, ValueType value);
+        void AddValue(ValueType value);
+        Key GetKey() const { return key; }
+
+    private:
+        Key key = { 0x243f6a8885a308d3ull, 0x13198a2e03707344ull };
+        void Add(uint64_t x);
+    };
+
+    explicit MemoCache(std::size_t capacity);
+
+    bool Find(const Key& key, ValueType& value);
+    void Insert(const Key& key, ValueType value);
+
+    std::size_t GetHitsCount() const { return hits_count.load(); }
+    std::size_t GetMissesCount() const { return misses_count.load(); }
+    std::size_t GetSize();
+    // Approximate number of bytes used by the cache.
+    std::size_t GetMemoryUsage();
+
+private:
+    static const int kStripesCount = 64;
+
+    struct Entry {
+        Key key;
+        ValueType value;
+        bool is_referenced;
+    };
+
+    struct KeyHash {
+        std::size_t operator()(const Key& key) const {
+            return key.hash;
+        }
+    };
+
+    struct Stripe {
+        std::mutex mutex;
+        std::vector<Entry> entries;
+        std::unordered_map<Key, int, KeyHash> index;
+        std::size_t clock_hand = 0;
+    };
+
+    std::size_t stripe_capacity;
+    Stripe stripes[kStripesCount];
+
+    std::atomic<std::size_t> hits_count{0};
+    std::atomic<std::size_t> misses_count{0};
+
+    Stripe& GetStripe(const Key& key) {
+        // High bits choose the stripe, buckets of the stripe index are chosen by the whole hash.
+        return stripes[(key.hash >> 48) % kStripesCount];
+    }
+};
+
+#endif //SPREADSHEETENGINE_MEMO_CACHE_H
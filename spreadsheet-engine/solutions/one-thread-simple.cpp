@@ -2,7 +2,7 @@
 #include "one-thread-simple.h"
 
 void OneThreadSimpleSolution::Calculate(int cell) {
-    ValueType value = 0;
+    SumType value = 0;
     for (const auto& it : cells[cell].formula) {
         switch (it.type) {
             case Addend::CELL: {
@@ -19,7 +19,7 @@ void OneThreadSimpleSolution::Calculate(int cell) {
             }
 
             case Addend::VALUE:
-                value += it.value;
+                value = sum(value, it.value);
                 break;
 
             default:
@@ -29,7 +29,7 @@ void OneThreadSimpleSolution::Calculate(int cell) {
 
     auto& c = cells[cell];
     c.is_calculated = true;
-    c.value = value;
+    c.value = SumValue(value);
 }
 
 void OneThreadSimpleSolution::BuildTopSortRecalculations(int cell) {
@@ -66,12 +66,13 @@ void OneThreadSimpleSolution::CalculateDependencies(int cell) {
 
 void OneThreadSimpleSolution::InitialCalculate(const InputData& initial_data) {
     cells.resize(initial_data.size());
+    ids.Clear();
+    ids.Reserve(initial_data.size());
 
     for (const auto& it : initial_data) {
         cells[it.id].formula = it.formula;
-        cells[it.id].name = it.name;
         CalculateDependencies(it.id);
-        id_by_name[it.name] = it.id;
+        ids.Insert(it.name, it.id);
     }
 
     for (const auto& it : initial_data) {
@@ -80,7 +81,10 @@ void OneThreadSimpleSolution::InitialCalculate(const InputData& initial_data) {
 }
 
 void OneThreadSimpleSolution::ChangeCell(const std::string& cell, const Formula& formula) {
-    int cell_id = id_by_name[cell];
+    int cell_id = ids.Find(cell);
+    if (!IsKnownEdit(cell_id, formula, cells.size())) {
+        return;
+    }
     RecalculateDependencies(cell_id, formula);
     need_to_recalculate.clear();
     top_sort_recalculations.clear();
@@ -94,7 +98,7 @@ OutputData OneThreadSimpleSolution::GetCurrentValues() {
     OutputData result = OutputData();
     int id = 0;
     for (const auto& cell : cells) {
-        result[cell.name] = cell.value;
+        result[ids.GetName(id)] = cell.value;
         id++;
     }
     return result;
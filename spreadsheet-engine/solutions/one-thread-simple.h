@@ -3,6 +3,7 @@
 
 #include <unordered_set>
 #include "solution.h"
+#include "../cell-ids.h"
 
 // Solution is simple implementation of task in one thread.
 // It based on dfs (depth-first search).
@@ -14,14 +15,13 @@ private:
         bool is_calculated = false;
         ValueType value;
         Formula formula;
-        std::string name;
     };
 
     std::vector<CellInfo> cells;
 
     std::unordered_set<int> need_to_recalculate;
     std::vector<int> top_sort_recalculations;
-    std::unordered_map<std::string, int> id_by_name;
+    CellIds ids;
 
     void Calculate(int cell);
     void BuildTopSortRecalculations(int cell);
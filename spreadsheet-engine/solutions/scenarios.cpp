@@ -0,0 +1,90 @@
+#include "scenarios.h"
+
+template <int K>
+ScenarioSolution<K>::ScenarioSolution(std::shared_ptr<const ForkBase> base)
+    : ScenarioSolution(base, GetSumLanesKernel(K)) {
+}
+
+template <int K>
+ScenarioSolution<K>::ScenarioSolution(std::shared_ptr<const ForkBase> base, SumLanesKernel kernel)
+    : base(base), kernel(kernel), values(base->cells_count), is_input(base->cells_count, false),
+      unresolved(base->cells_count, 0), is_reached(base->cells_count, false) {
+    for (std::size_t cell = 0; cell < base->cells_count; cell++) {
+        ValueType value = (*base->value_pages[cell >> ForkBase::kPageBits])[cell & (ForkBase::kPageSize - 1)];
+        for (int lane = 0; lane < K; lane++) {
+            values[cell].value[lane] = value;
+        }
+    }
+}
+
+template <int K>
+void ScenarioSolution<K>::SetInput(int cell, const Lanes& input) {
+    values[cell] = input;
+    is_input[cell] = true;
+    changed_inputs.push_back(cell);
+}
+
+// Kernels read values of cell c from values[c * K].
+template <int K>
+void ScenarioSolution<K>::CalculateCellValues(int cell) {
+    static_assert(sizeof(Lanes) == K * sizeof(ValueType), "lanes are not a dense array of values");
+    const Addend* begin = base->addends.data() + base->formula_offsets[cell];
+    const Addend* end = base->addends.data() + base->formula_offsets[cell + 1];
+    const ValueType* dense_values = values.data()->value;
+    if constexpr (K == 1) {
+        values[cell].value[0] = SumFormula(begin, end, dense_values);
+    } else {
+        kernel.function(begin, end, dense_values, values[cell].value);
+    }
+}
+
+// Kahn's algorithm on cells reachable from changed inputs. An input which is reachable from another one keeps
+// its values, but it is visited in topological order, so its dependents wait for all their precedents.
+template <int K>
+void ScenarioSolution<K>::Recalculate() {
+    std::vector<int> reachable;
+    for (int cell : changed_inputs) {
+        if (!is_reached[cell]) {
+            is_reached[cell] = true;
+            reachable.push_back(cell);
+        }
+    }
+    changed_inputs.clear();
+    for (std::size_t i = 0; i < reachable.size(); i++) {
+        int cell = reachable[i];
+        for (uint64_t j = base->dependent_offsets[cell]; j < base->dependent_offsets[cell + 1]; j++) {
+            int dependent = base->dependents[j];
+            unresolved[dependent]++;
+            if (!is_reached[dependent]) {
+                is_reached[dependent] = true;
+                reachable.push_back(dependent);
+            }
+        }
+    }
+
+    std::vector<int> ready;
+    for (int cell : reachable) {
+        if (unresolved[cell] == 0) {
+            ready.push_back(cell);
+        }
+    }
+    while (!ready.empty()) {
+        int cell = ready.back();
+        ready.pop_back();
+        is_reached[cell] = false;
+        if (!is_input[cell]) {
+            CalculateCellValues(cell);
+        }
+        for (uint64_t j = base->dependent_offsets[cell]; j < base->dependent_offsets[cell + 1]; j++) {
+            int dependent = base->dependents[j];
+            if (--unresolved[dependent] == 0) {
+                ready.push_back(dependent);
+            }
+        }
+    }
+}
+
+template class ScenarioSolution<1>;
+template class ScenarioSolution<4>;
+template class ScenarioSolution<8>;
+template class ScenarioSolution<16>;
@@ -0,0 +1,60 @@
+#ifndef SPREADSHEETENGINE_SCENARIOS_H
+#define SPREADSHEETENGINE_SCENARIOS_H
+
+#include <memory>
+#include <vector>
+
+#include "fork.h"
+#include "formula-kernels.h"
+
+// Evaluation of K scenarios of the same workbook in one pass, e.g. for sensitivity runs. A cell keeps K values,
+// one per scenario, and inputs of scenarios are cells whose formulas are replaced by values. Recalculate() walks
+// cells reachable from changed inputs once and evaluates every formula for all K lanes by the lane kernel selected
+// for the CPU (AVX-512, AVX2 or SSE2, see formula-kernels.h). A single lane gathers values of precedents
+// by the kernel selected for the CPU and the size of the formula.
+//
+// The solution is built on the frozen state of FastSolution, cells are identified by its ids. It is evaluated
+// in one thread. K is a power of 2 up to 16 (a cell is one 64-byte cache line then).
+template <int K>
+class ScenarioSolution {
+    static_assert(K > 0 && K <= 16 && (K & (K - 1)) == 0, "lanes count should be a power of 2 up to 16");
+
+public:
+    static const int kLanes = K;
+
+    // Values of a cell in all scenarios.
+    struct alignas(K * sizeof(ValueType)) Lanes {
+        ValueType value[K];
+    };
+
+    explicit ScenarioSolution(std::shared_ptr<const ForkBase> base);
+    // The kernel should be one of GetSumLanesKernels(K), it is not used for one lane.
+    ScenarioSolution(std::shared_ptr<const ForkBase> base, SumLanesKernel kernel);
+
+    // The cell gets the value of each scenario instead of its formula. Dependents are recalculated by Recalculate().
+    void SetInput(int cell, const Lanes& values);
+    // Evaluates cells which depend on inputs set since the last call.
+    void Recalculate();
+
+    const Lanes& GetLanes(int cell) const { return values[cell]; }
+    ValueType GetValue(int cell, int scenario) const { return values[cell].value[scenario]; }
+    std::size_t GetCellsCount() const { return base->cells_count; }
+    const char* GetKernelName() const { return kernel.name; }
+
+private:
+    std::shared_ptr<const ForkBase> base;
+    SumLanesKernel kernel;
+    std::vector<Lanes> values;
+    std::vector<bool> is_input;
+    // Inputs which were set since the last Recalculate().
+    std::vector<int> changed_inputs;
+
+    // Numbers of unevaluated precedents of reachable cells and marks of reached cells. They are zero between calls
+    // of Recalculate(), so only reached cells are touched.
+    std::vector<int> unresolved;
+    std::vector<bool> is_reached;
+
+    void CalculateCellValues(int cell);
+};
+
+#endif //SPREADSHEETENGINE_SCENARIOS_H
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <execution>
+#include <fstream>
+#include <numeric>
+
+#include "snapshot.h"
+
+#ifdef _WIN32
+  #include <io.h>
+#else
+  #include <cerrno>
+  #include <unistd.h>
+#endif
+
+// Word at a time mix, much faster than byte oriented hashes and good enough to detect corruption.
+uint64_t snapshot_checksum(const void* data, std::size_t size) {
+    const char* p = (const char*) data;
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ size;
+    std::size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, p + i, 8);
+        hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, p + i, size - i);
+    hash = (hash ^ tail) * 0xc4ceb9fe1a85ec53ull;
+    return hash ^ (hash >> 29);
+}
+
+static std::size_t align_size(std::size_t size) {
+    return (size + 7) / 8 * 8;
+}
+
+bool SnapshotWriter::BuildHeader(SnapshotHeader& header, bool parallel) const {
+    if (sections.size() > SnapshotHeader::kMaxSectionsCount) {
+        return false;
+    }
+
+    std::memset(&header, 0, sizeof(header));
+    header.magic = SnapshotHeader::kMagic;
+    header.version = version;
+    header.sections_count = sections.size();
+    uint64_t offset = align_size(sizeof(SnapshotHeader));
+    for (std::size_t i = 0; i < sections.size(); i++) {
+        header.sections[i].offset = offset;
+        header.sections[i].size = sections[i].size;
+        offset += align_size(sections[i].size);
+    }
+    std::vector<int> order(sections.size());
+    std::iota(order.begin(), order.end(), 0);
+    auto calculate_checksum = [&](int i) {
+        header.sections[i].checksum = snapshot_checksum(sections[i].data, sections[i].size);
+    };
+    if (parallel) {
+        std::for_each(std::execution::par_unseq, order.begin(), order.end(), calculate_checksum);
+    } else {
+        std::for_each(std::execution::seq, order.begin(), order.end(), calculate_checksum);
+    }
+    header.checksum = snapshot_checksum(&header, offsetof(SnapshotHeader, checksum));
+    return true;
+}
+
+bool SnapshotWriter::Write(const std::string& file_path, bool parallel) {
+    SnapshotHeader header;
+    if (!BuildHeader(header, parallel)) {
+        return false;
+    }
+
+    std::ofstream output_file(file_path, std::ios::binary | std::ios::trunc);
+    if (!output_file.is_open()) {
+        return false;
+    }
+    const char padding[8] = {};
+    output_file.write((const char*) &header, sizeof(header));
+    output_file.write(padding, align_size(sizeof(header)) - sizeof(header));
+    for (const auto& it : sections) {
+        output_file.write((const char*) it.data, it.size);
+        output_file.write(padding, align_size(it.size) - it.size);
+    }
+    output_file.close();
+    return !output_file.fail();
+}
+
+static bool write_all(int fd, const char* data, std::size_t size) {
+    while (size > 0) {
+        std::size_t part = std::min<std::size_t>(size, 1 << 30);
+#ifdef _WIN32
+        int result = _write(fd, data, (unsigned int) part);
+#else
+        ssize_t result = write(fd, data, part);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+#endif
+        if (result <= 0) {
+            return false;
+        }
+        data += result;
+        size -= result;
+    }
+    return true;
+}
+
+bool SnapshotWriter::Write(int fd, bool parallel) {
+    SnapshotHeader header;
+    const char padding[8] = {};
+    bool ok = BuildHeader(header, parallel) && write_all(fd, (const char*) &header, sizeof(header)) &&
+              write_all(fd, padding, align_size(sizeof(header)) - sizeof(header));
+    for (std::size_t i = 0; ok && i < sections.size(); i++) {
+        ok = write_all(fd, (const char*) sections[i].data, sections[i].size) &&
+             write_all(fd, padding, align_size(sections[i].size) - sections[i].size);
+    }
+#ifdef _WIN32
+    return _close(fd) == 0 && ok;
+#else
+    return close(fd) == 0 && ok;
+#endif
+}
+
+uint64_t SnapshotWriter::WriteAsync(const std::string& file_path, AsyncFileIO& io, std::shared_ptr<const void> owner,
+                                    bool parallel) {
+    static const char padding[8] = {};
+    auto header = std::make_shared<SnapshotHeader>();
+    if (!BuildHeader(*header, parallel)) {
+        return 0;
+    }
+
+    std::vector<AsyncFileIO::Buffer> buffers;
+    auto add = [&](const void* data, std::size_t size) {
+        buffers.push_back({ data, size });
+        if (align_size(size) != size) {
+            buffers.push_back({ padding, align_size(size) - size });
+        }
+    };
+    add(header.get(), sizeof(SnapshotHeader));
+    for (const auto& it : sections) {
+        add(it.data, it.size);
+    }
+    auto owners = std::make_shared<std::pair<std::shared_ptr<SnapshotHeader>, std::shared_ptr<const void>>>(header, owner);
+    return io.WriteFile(file_path, std::move(buffers), false, owners);
+}
+
+SnapshotReader::SnapshotReader(const std::string& file_path, uint32_t version, uint32_t sections_count) : file(file_path) {
+    if (!file.IsOpen()) {
+        error = "Unable to open file " + file_path;
+        return;
+    }
+    if (file.Size() < sizeof(SnapshotHeader)) {
+        error = "File is too small";
+        return;
+    }
+
+    header = reinterpret_cast<const SnapshotHeader*>(file.Data());
+    if (header->magic != SnapshotHeader::kMagic) {
+        error = "File is not a snapshot";
+        return;
+    }
+    if (header->checksum != snapshot_checksum(header, offsetof(SnapshotHeader, checksum))) {
+        error = "Header checksum mismatch";
+        return;
+    }
+    if (header->version != version || header->sections_count != sections_count) {
+        error = "Unsupported version " + std::to_string(header->version);
+        return;
+    }
+    for (uint32_t i = 0; i < sections_count; i++) {
+        const auto& it = header->sections[i];
+        if (it.offset % 8 != 0 || it.offset > file.Size() || it.size > file.Size() - it.offset) {
+            error = "Section " + std::to_string(i) + " is out of file";
+            return;
+        }
+    }
+
+    std::atomic<bool> checksums_match{true};
+    std::vector<int> order(sections_count);
+    std::iota(order.begin(), order.end(), 0);
+    std::for_each(std::execution::par_unseq, order.begin(), order.end(), [&](int i) {
+        const auto& it = header->sections[i];
+        if (snapshot_checksum(file.Data() + it.offset, it.size) != it.checksum) {
+            checksums_match = false;
+        }
+    });
+    if (!checksums_match) {
+        error = "Section checksum mismatch";
+        return;
+    }
+    is_valid = true;
+}
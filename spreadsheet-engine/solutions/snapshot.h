@@ -0,0 +1,97 @@
+#ifndef SPREADSHEETENGINE_SNAPSHOT_H
+#define SPREADSHEETENGINE_SNAPSHOT_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../async-file-io.h"
+#include "../mapped-file.h"
+
+// Binary snapshot file: a header followed by sections. Every section is an array of fixed-size elements
+// aligned to 8 bytes. Header keeps offset, size and checksum of every section, so a reader maps the file
+// and uses the arrays in place without parsing.
+struct SnapshotHeader {
+    static const uint64_t kMagic = 0x31504e5353454e45ull; // "ENSSNP1" in little endian
+    static const int kMaxSectionsCount = 16;
+
+    struct Section {
+        uint64_t offset;
+        uint64_t size;
+        uint64_t checksum;
+    };
+
+    uint64_t magic;
+    // Version of the format of sections, it is defined by the solution which writes the snapshot.
+    uint32_t version;
+    uint32_t sections_count;
+    Section sections[kMaxSectionsCount];
+    // Checksum of all fields above
+    uint64_t checksum;
+};
+
+uint64_t snapshot_checksum(const void* data, std::size_t size);
+
+// Collects sections and writes them to the file. Data of sections is not copied, it should be alive until Write().
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(uint32_t version) : version(version) {}
+
+    // Sections are numbered in order of adding.
+    template <typename T>
+    void AddSection(const std::vector<T>& data) {
+        AddSection(data.data(), data.size());
+    }
+
+    template <typename T>
+    void AddSection(const T* data, std::size_t count) {
+        sections.push_back({ data, count * sizeof(T) });
+    }
+
+    // Checksums are calculated in parallel if 'parallel' is true.
+    bool Write(const std::string& file_path, bool parallel = true);
+    // Writes to the open file by plain write() calls without streams and closes it. It is used by a forked child,
+    // where locks of other threads of the parent can be held forever.
+    bool Write(int fd, bool parallel);
+
+    // Checksums are calculated before return, then the file is written by 'io'. 'owner' keeps data of sections alive
+    // until the file is written. Returns the request of 'io', 0 if there are too many sections.
+    uint64_t WriteAsync(const std::string& file_path, AsyncFileIO& io, std::shared_ptr<const void> owner, bool parallel = true);
+
+private:
+    struct Section {
+        const void* data;
+        std::size_t size;
+    };
+
+    uint32_t version;
+    std::vector<Section> sections;
+
+    bool BuildHeader(SnapshotHeader& header, bool parallel) const;
+};
+
+// Maps the snapshot file and validates the header and checksums of all sections.
+class SnapshotReader {
+public:
+    SnapshotReader(const std::string& file_path, uint32_t version, uint32_t sections_count);
+
+    bool IsValid() const { return is_valid; }
+    const std::string& GetError() const { return error; }
+
+    // Returns the section as an array of 'count' elements.
+    template <typename T>
+    const T* GetSection(int section, std::size_t& count) const {
+        const SnapshotHeader::Section& it = header->sections[section];
+        count = it.size / sizeof(T);
+        return reinterpret_cast<const T*>(file.Data() + it.offset);
+    }
+
+private:
+    MappedFile file;
+    const SnapshotHeader* header = nullptr;
+    bool is_valid = false;
+    std::string error;
+};
+
+#endif //SPREADSHEETENGINE_SNAPSHOT_H
@@ -1,7 +1,9 @@
 #ifndef SPREADSHEETENGINE_SOLUTION_H
 #define SPREADSHEETENGINE_SOLUTION_H
 
+#include <cstdint>
 #include <iostream>
+#include <limits>
 
 #include <thread>
 #include <chrono>
@@ -10,15 +12,54 @@
 
 const int milliseconds = 0;
 
-inline ValueType sum(ValueType a, ValueType b) {
+// Partial sums of a formula are 64-bit, so they don't overflow, and an error is kept out of their range: the sum
+// doesn't depend on the order of addends. SumValue() wraps the result around to 32 bits once.
+using SumType = int64_t;
+const SumType kSumError = std::numeric_limits<SumType>::min();
+
+inline SumType sum(SumType a, ValueType b) {
     //std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+    if (a == kSumError || b == kReferenceError) {
+        return kSumError;
+    }
     return a + b;
 }
 
+// The value of a cell: the sum wraps around as 32-bit integers do, but a sum which lands on the reserved
+// kReferenceError is kMinValue, so no valid value is taken for an error.
+inline ValueType SumValue(SumType value) {
+    if (value == kSumError) {
+        return kReferenceError;
+    }
+    ValueType result = (ValueType) (uint32_t) (uint64_t) value;
+    return result == kReferenceError ? kMinValue : result;
+}
+
+// Only FastSolution adds cells. Other solutions ignore an edit of an unknown cell ('cell' is -1) or an edit
+// whose formula references unknown cells.
+inline bool IsKnownEdit(int cell, const Formula& formula, std::size_t cells_count) {
+    if (cell < 0) {
+        return false;
+    }
+    for (const auto& it : formula) {
+        if (it.type == Addend::CELL && (it.value < 0 || it.value >= (int) cells_count)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 class Solution {
 public:
+    virtual ~Solution() = default;
+
     virtual void InitialCalculate(const InputData& inputData) = 0;
+    // An unknown cell is added by FastSolution and ignored by other solutions (see IsKnownEdit()).
     virtual void ChangeCell(const std::string& cell, const Formula& formula) = 0;
+
+    // The same, but the input can be taken by the solution instead of copying it.
+    virtual void InitialCalculate(InputData&& input_data) { InitialCalculate(static_cast<const InputData&>(input_data)); }
+    virtual void ChangeCell(const std::string& cell, Formula&& formula) { ChangeCell(cell, static_cast<const Formula&>(formula)); }
     virtual OutputData GetCurrentValues() = 0;
 };
 
@@ -0,0 +1,428 @@
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <unordered_set>
+
+#include "tiled.h"
+#include "../utils.h"
+
+// -------------- Tiles building --------------
+
+// Tarjan's algorithm (without recursion). Returns strongly connected component of each vertex.
+static std::vector<int> StronglyConnectedComponents(const std::vector<std::vector<int>>& graph) {
+    int n = graph.size();
+    std::vector<int> index(n, -1);
+    std::vector<int> low(n, 0);
+    std::vector<int> component(n, -1);
+    std::vector<bool> on_stack(n, false);
+    std::vector<int> stack;
+    std::vector<std::pair<int, std::size_t>> call_stack;
+    int next_index = 0;
+    int components_count = 0;
+
+    auto visit = [&](int v) {
+        index[v] = low[v] = next_index++;
+        stack.push_back(v);
+        on_stack[v] = true;
+        call_stack.emplace_back(v, 0);
+    };
+
+    for (int root = 0; root < n; root++) {
+        if (index[root] != -1) {
+            continue;
+        }
+        visit(root);
+        while (!call_stack.empty()) {
+            int v = call_stack.back().first;
+            std::size_t& edge = call_stack.back().second;
+            if (edge < graph[v].size()) {
+                int u = graph[v][edge++];
+                if (index[u] == -1) {
+                    visit(u);
+                } else if (on_stack[u]) {
+                    low[v] = std::min(low[v], index[u]);
+                }
+                continue;
+            }
+
+            call_stack.pop_back();
+            if (!call_stack.empty()) {
+                int parent = call_stack.back().first;
+                low[parent] = std::min(low[parent], low[v]);
+            }
+            if (low[v] == index[v]) {
+                int u;
+                do {
+                    u = stack.back();
+                    stack.pop_back();
+                    on_stack[u] = false;
+                    component[u] = components_count;
+                } while (u != v);
+                components_count++;
+            }
+        }
+    }
+    return component;
+}
+
+void TiledSolution::BuildTiles() {
+    // Split cells by column and row range
+    std::unordered_map<long long, int> raw_tile_by_key;
+    std::vector<int> raw_tile(cells.size());
+    for (std::size_t cell = 0; cell < cells.size(); cell++) {
+        int column, row;
+        ids.GetPosition(cell, column, row);
+        long long key = (long long) (row / kTileRows) * 26 + column;
+        auto it = raw_tile_by_key.find(key);
+        if (it == raw_tile_by_key.end()) {
+            it = raw_tile_by_key.emplace(key, raw_tile_by_key.size()).first;
+        }
+        raw_tile[cell] = it->second;
+    }
+
+    // Merge tiles which form a cycle
+    std::vector<std::vector<int>> raw_graph(raw_tile_by_key.size());
+    for (std::size_t cell = 0; cell < cells.size(); cell++) {
+        for (const auto& it : cells[cell].formula) {
+            if (it.type == Addend::CELL && raw_tile[it.value] != raw_tile[cell]) {
+                raw_graph[raw_tile[it.value]].push_back(raw_tile[cell]);
+            }
+        }
+    }
+    for (auto& it : raw_graph) {
+        std::sort(it.begin(), it.end());
+        it.erase(std::unique(it.begin(), it.end()), it.end());
+    }
+    std::vector<int> component = StronglyConnectedComponents(raw_graph);
+
+    int tiles_count = component.empty() ? 0 : *std::max_element(component.begin(), component.end()) + 1;
+    for (int i = 0; i < tiles_count; i++) {
+        tiles.push_back(new Tile());
+    }
+    for (std::size_t cell = 0; cell < cells.size(); cell++) {
+        int tile = component[raw_tile[cell]];
+        cells[cell].tile = tile;
+        tiles[tile]->cells.push_back(cell);
+    }
+
+    for (std::size_t cell = 0; cell < cells.size(); cell++) {
+        int tile = cells[cell].tile;
+        for (const auto& it : cells[cell].formula) {
+            if (it.type != Addend::CELL) {
+                continue;
+            }
+            cells[it.value].dependencies.push_back(cell);
+            int previous_tile = cells[it.value].tile;
+            if (previous_tile != tile) {
+                tiles[previous_tile]->next_tiles[tile]++;
+                tiles[tile]->previous_tiles[previous_tile]++;
+            }
+        }
+    }
+
+    std::vector<int> tile_ids(tiles.size());
+    std::iota(tile_ids.begin(), tile_ids.end(), 0);
+    std::for_each(std::execution::par_unseq, tile_ids.begin(), tile_ids.end(), [&](int tile) { SortTile(tile); });
+}
+
+// Kahn's algorithm on edges inside the tile.
+void TiledSolution::SortTile(int tile) {
+    std::vector<int>& tile_cells = tiles[tile]->cells;
+    std::vector<int> order;
+    order.reserve(tile_cells.size());
+
+    for (const auto& cell : tile_cells) {
+        int cnt = 0;
+        for (const auto& it : cells[cell].formula) {
+            cnt += it.type == Addend::CELL && cells[it.value].tile == tile;
+        }
+        cells[cell].unresolved_cells_count = cnt;
+        if (cnt == 0) {
+            order.push_back(cell);
+        }
+    }
+
+    for (std::size_t i = 0; i < order.size(); i++) {
+        for (const auto& next : cells[order[i]].dependencies) {
+            if (cells[next].tile == tile && --cells[next].unresolved_cells_count == 0) {
+                order.push_back(next);
+            }
+        }
+    }
+
+    tile_cells = std::move(order);
+}
+
+std::vector<int> TiledSolution::ReachableTiles(int tile) {
+    epoch++;
+    std::vector<int> reachable = { tile };
+    tiles[tile]->reachable_epoch = epoch;
+    for (std::size_t i = 0; i < reachable.size(); i++) {
+        for (const auto& it : tiles[reachable[i]]->next_tiles) {
+            if (tiles[it.first]->reachable_epoch != epoch) {
+                tiles[it.first]->reachable_epoch = epoch;
+                reachable.push_back(it.first);
+            }
+        }
+    }
+    return reachable;
+}
+
+// If a new edge between tiles closes a cycle, all tiles of the cycles are merged.
+void TiledSolution::AddEdge(int from, int to) {
+    cells[from].dependencies.push_back(to);
+
+    int from_tile = cells[from].tile;
+    int to_tile = cells[to].tile;
+    if (from_tile == to_tile) {
+        return;
+    }
+    tiles[to_tile]->previous_tiles[from_tile]++;
+    if (++tiles[from_tile]->next_tiles[to_tile] > 1) {
+        return;
+    }
+
+    std::vector<int> reachable = ReachableTiles(to_tile);
+    if (tiles[from_tile]->reachable_epoch != epoch) {
+        return;
+    }
+
+    // Tiles on a cycle are reachable from 'to_tile' and 'from_tile' is reachable from them.
+    std::vector<int> cycle = { from_tile };
+    std::unordered_set<int> visited = { from_tile };
+    for (std::size_t i = 0; i < cycle.size(); i++) {
+        for (const auto& it : tiles[cycle[i]]->previous_tiles) {
+            if (tiles[it.first]->reachable_epoch == epoch && visited.insert(it.first).second) {
+                cycle.push_back(it.first);
+            }
+        }
+    }
+    MergeTiles(cycle);
+}
+
+void TiledSolution::RemoveEdge(int from, int to) {
+    auto& dependencies = cells[from].dependencies;
+    dependencies.erase(std::find(dependencies.begin(), dependencies.end(), to));
+
+    int from_tile = cells[from].tile;
+    int to_tile = cells[to].tile;
+    if (from_tile == to_tile) {
+        return;
+    }
+    if (--tiles[from_tile]->next_tiles[to_tile] == 0) {
+        tiles[from_tile]->next_tiles.erase(to_tile);
+    }
+    if (--tiles[to_tile]->previous_tiles[from_tile] == 0) {
+        tiles[to_tile]->previous_tiles.erase(from_tile);
+    }
+}
+
+// Cells of all tiles are moved into the first one, other tiles become empty.
+// Local order of the result tile should be rebuilt by SortTile().
+void TiledSolution::MergeTiles(const std::vector<int>& tiles_to_merge) {
+    int result = tiles_to_merge[0];
+    std::unordered_set<int> merged(tiles_to_merge.begin(), tiles_to_merge.end());
+    std::unordered_map<int, int> next_tiles;
+    std::unordered_map<int, int> previous_tiles;
+
+    for (const auto& tile : tiles_to_merge) {
+        Tile* info = tiles[tile];
+        for (const auto& it : info->next_tiles) {
+            if (merged.find(it.first) == merged.end()) {
+                next_tiles[it.first] += it.second;
+                tiles[it.first]->previous_tiles.erase(tile);
+            }
+        }
+        for (const auto& it : info->previous_tiles) {
+            if (merged.find(it.first) == merged.end()) {
+                previous_tiles[it.first] += it.second;
+                tiles[it.first]->next_tiles.erase(tile);
+            }
+        }
+        info->next_tiles.clear();
+        info->previous_tiles.clear();
+
+        if (tile != result) {
+            for (const auto& cell : info->cells) {
+                cells[cell].tile = result;
+                tiles[result]->cells.push_back(cell);
+            }
+            info->cells.clear();
+        }
+    }
+
+    for (const auto& it : next_tiles) {
+        tiles[it.first]->previous_tiles[result] = it.second;
+    }
+    for (const auto& it : previous_tiles) {
+        tiles[it.first]->next_tiles[result] = it.second;
+    }
+    tiles[result]->next_tiles = std::move(next_tiles);
+    tiles[result]->previous_tiles = std::move(previous_tiles);
+}
+
+// -------------- Values calculation --------------
+
+// Calculates cells of the tile in local topological order. If only one cell was changed, we calculate only cells
+// which have a changed cell in formula, and a cell is marked as changed only if its value is really changed.
+void TiledSolution::CalculateTile(int tile) {
+    Tile* info = tiles[tile];
+    bool all_cells = changed_cell == -1;
+
+    if (all_cells || info->has_changed_input.load() || cells[changed_cell].tile == tile) {
+        for (const auto& cell : info->cells) {
+            auto& c_info = cells[cell];
+
+            bool need_to_calculate = all_cells || cell == changed_cell;
+            for (const auto& it : c_info.formula) {
+                if (need_to_calculate) {
+                    break;
+                }
+                need_to_calculate = it.type == Addend::CELL && cells[it.value].changed_epoch == epoch;
+            }
+            if (!need_to_calculate) {
+                continue;
+            }
+
+            SumType formula_sum = 0;
+            for (const auto& it : c_info.formula) {
+                formula_sum = sum(formula_sum, it.type == Addend::CELL ? cells[it.value].value : it.value);
+            }
+            ValueType value = SumValue(formula_sum);
+
+            if (all_cells || value != c_info.value) {
+                c_info.value = value;
+                c_info.changed_epoch = epoch;
+                if (all_cells) {
+                    continue;
+                }
+                for (const auto& next : c_info.dependencies) {
+                    if (cells[next].tile != tile) {
+                        tiles[cells[next].tile]->has_changed_input.store(true, std::memory_order_relaxed);
+                    }
+                }
+            }
+        }
+    }
+
+    for (const auto& it : info->next_tiles) {
+        Tile* next = tiles[it.first];
+        if (next->reachable_epoch == epoch && next->unresolved_tiles_count.fetch_sub(1) == 1) {
+            lock_free_queue.enqueue(it.first);
+        }
+    }
+    calculated_tiles_count++;
+}
+
+void TiledSolution::CalculateTilesThreadJob() {
+    int tile;
+    while (calculated_tiles_count.load() < tiles_to_calculate) {
+        if (lock_free_queue.try_dequeue(tile)) {
+            CalculateTile(tile);
+        }
+    }
+}
+
+// All 'tiles_to_calculate' should be marked by the current epoch.
+void TiledSolution::CalculateTiles(const std::vector<int>& tiles_list, const std::vector<int>& starting_tiles) {
+    for (const auto& tile : tiles_list) {
+        int cnt = 0;
+        for (const auto& it : tiles[tile]->previous_tiles) {
+            cnt += tiles[it.first]->reachable_epoch == epoch;
+        }
+        tiles[tile]->unresolved_tiles_count.store(cnt);
+        tiles[tile]->has_changed_input.store(false);
+    }
+
+    tiles_to_calculate = tiles_list.size();
+    calculated_tiles_count = 0;
+    if (tiles_list.size() == 1) {
+        CalculateTile(tiles_list[0]);
+        return;
+    }
+
+    lock_free_queue = moodycamel::BlockingConcurrentQueue<int>(tiles_list.size());
+    for (const auto& tile : starting_tiles) {
+        lock_free_queue.enqueue(tile);
+    }
+    runMultipleThreads([&]() { CalculateTilesThreadJob(); });
+}
+
+void TiledSolution::InitialCalculate(const InputData& input_data) {
+    for (const auto& it : tiles) {
+        delete it;
+    }
+    tiles.clear();
+    ids.Clear();
+    ids.Reserve(input_data.size());
+    cells.assign(input_data.size(), CellInfo());
+
+    for (const auto& it : input_data) {
+        cells[it.id].formula = it.formula;
+        ids.Insert(it.name, it.id);
+    }
+
+    {
+#ifdef _DEBUG
+        Timer timer("        Building tiles time: ");
+#endif
+        BuildTiles();
+    }
+
+    epoch++;
+    std::vector<int> tiles_list(tiles.size());
+    std::vector<int> starting_tiles;
+    for (std::size_t tile = 0; tile < tiles.size(); tile++) {
+        tiles_list[tile] = tile;
+        tiles[tile]->reachable_epoch = epoch;
+        if (tiles[tile]->previous_tiles.empty()) {
+            starting_tiles.push_back(tile);
+        }
+    }
+
+    changed_cell = -1;
+    CalculateTiles(tiles_list, starting_tiles);
+}
+
+// -------------- Change formula of a cell --------------
+
+void TiledSolution::ChangeCell(const std::string& cell, const Formula& formula) {
+    int cell_id = ids.Find(cell);
+    if (!IsKnownEdit(cell_id, formula, cells.size())) {
+        return;
+    }
+    Formula old_formula = std::move(cells[cell_id].formula);
+    cells[cell_id].formula = formula;
+
+    // New edges are added first, so edges between tiles which are not changed don't disappear.
+    bool structure_changed = false;
+    for (const auto& it : formula) {
+        if (it.type == Addend::CELL) {
+            AddEdge(it.value, cell_id);
+            structure_changed = true;
+        }
+    }
+    for (const auto& it : old_formula) {
+        if (it.type == Addend::CELL) {
+            RemoveEdge(it.value, cell_id);
+            structure_changed = true;
+        }
+    }
+    if (structure_changed) {
+        SortTile(cells[cell_id].tile);
+    }
+
+    changed_cell = cell_id;
+    int tile = cells[cell_id].tile;
+    CalculateTiles(ReachableTiles(tile), { tile });
+}
+
+// -------------- Return current state of cells --------------
+
+OutputData TiledSolution::GetCurrentValues() {
+    OutputData result = OutputData();
+    for (std::size_t cell = 0; cell < cells.size(); cell++) {
+        result[ids.GetName(cell)] = cells[cell].value;
+    }
+    return result;
+}
@@ -0,0 +1,91 @@
+#ifndef SPREADSHEETENGINE_TILED_H
+#define SPREADSHEETENGINE_TILED_H
+
+#include <atomic>
+#include <unordered_map>
+
+#include "solution.h"
+#include "../cell-ids.h"
+#include "../lock-free-queue/blockingconcurrentqueue.h"
+
+// Solution schedules tiles (blocks of cells) instead of single cells.
+// Cell name is a column letter and a row number, so a tile is a column and a range of kTileRows rows.
+// Real sheets have column blocks of similar formulas, so most of edges are inside a tile or between neighbour tiles.
+//
+// Tile DAG: edge 'a' -> 'b' exists if and only if some cell of 'b' contains a cell of 'a' in its formula.
+// Tiles which form a cycle are merged, so tile DAG is always acyclic.
+// Threads take ready tiles from the queue and calculate cells of a tile in local topological order,
+// synchronization (queue, atomic counters) happens once per tile.
+class TiledSolution : public Solution {
+private:
+
+    static const int kTileRows = 256;
+
+    struct CellInfo {
+        Formula formula;
+        ValueType value = 0;
+        int tile = 0;
+        // Cells which contain this cell in formula (cell is repeated if formula contains it several times).
+        std::vector<int> dependencies;
+        // Equals to 'epoch' if value was changed by the current calculation.
+        int changed_epoch = 0;
+        // Used for local topological sort.
+        int unresolved_cells_count = 0;
+    };
+
+    struct Tile {
+        // Cells in local topological order.
+        std::vector<int> cells;
+        // Tile -> number of cell edges between tiles.
+        std::unordered_map<int, int> next_tiles;
+        std::unordered_map<int, int> previous_tiles;
+
+        std::atomic<int> unresolved_tiles_count;
+        // Some cell of previous tile which is used by this tile was changed.
+        std::atomic<bool> has_changed_input;
+        // Equals to 'epoch' if tile is reachable from the changed cell.
+        int reachable_epoch = 0;
+    };
+
+    std::vector<CellInfo> cells;
+    std::vector<Tile*> tiles;
+    CellIds ids;
+
+    moodycamel::BlockingConcurrentQueue<int> lock_free_queue;
+    std::atomic<int> calculated_tiles_count;
+    int tiles_to_calculate = 0;
+
+    int epoch = 0;
+    // Cell which formula was changed, -1 if all cells are calculated.
+    int changed_cell = -1;
+
+    void BuildTiles();
+    void SortTile(int tile);
+    void AddEdge(int from, int to);
+    void RemoveEdge(int from, int to);
+    void MergeTiles(const std::vector<int>& tiles_to_merge);
+    std::vector<int> ReachableTiles(int tile);
+
+    void CalculateTile(int tile);
+    void CalculateTilesThreadJob();
+    void CalculateTiles(const std::vector<int>& tiles_to_calculate, const std::vector<int>& starting_tiles);
+
+public:
+
+    // Time complexity is O(n) where n - number of vertices in input_data.
+    void InitialCalculate(const InputData& input_data) override;
+
+    // Time complexity is O(t) where t - total size of tiles which are reachable from the tile of 'cell'.
+    void ChangeCell(const std::string& cell, const Formula& formula) override;
+
+    OutputData GetCurrentValues() override;
+
+    ~TiledSolution() {
+        for (const auto& it : tiles) {
+            delete it;
+        }
+        tiles.clear();
+    }
+};
+
+#endif //SPREADSHEETENGINE_TILED_H
@@ -7,6 +7,8 @@
 #include <sstream>
 #include <utility>
 #include <thread>
+#include <vector>
+#include <functional>
 
 // Class which calculate execution time. 
 // When is's created it saves now().
@@ -27,6 +29,30 @@ public:
     }
 };
 
+// The same as Timer, but also prints throughput of processing 'bytes' bytes.
+// If the number of bytes is known only at the end, it can be set by SetBytes().
+class ThroughputTimer {
+private:
+    typedef std::chrono::high_resolution_clock clock_;
+    std::chrono::time_point<clock_> start;
+    std::string message;
+    std::size_t bytes;
+
+public:
+    explicit ThroughputTimer(std::string message, std::size_t bytes = 0) : start(clock_::now()), message(std::move(message)), bytes(bytes) {}
+    void SetBytes(std::size_t value) { bytes = value; }
+    ~ThroughputTimer() {
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(clock_::now() - start).count();
+        double megabytes_per_second = elapsed > 0 ? (double) bytes / elapsed : 0;
+        std::cout << message << elapsed / 1000 << " ms, " << megabytes_per_second << " MB/s" << std::endl;
+    }
+};
+
+inline std::size_t get_file_size(const std::string& file_path) {
+    std::ifstream file(file_path, std::ios::binary | std::ios::ate);
+    return file.is_open() ? (std::size_t) file.tellg() : 0;
+}
+
 inline std::string trim(std::string s) {
     s.erase(0, s.find_first_not_of(' '));
     s.erase(s.find_last_not_of(' ') + 1);
@@ -37,6 +63,19 @@ inline unsigned int get_threads_count() {
   return std::thread::hardware_concurrency();
 }
 
+inline void runMultipleThreads(const std::function<void()>& function) {
+    int threads_count = get_threads_count();
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threads_count; i++) {
+        threads.push_back(std::thread(function));
+    }
+
+    for (int i = 0; i < threads_count; i++) {
+        threads[i].join();
+    }
+}
+
 inline bool files_are_equal(const std::string& expected_path, const std::string& actual_path, std::string& error_message) {
     std::ifstream expected_file(expected_path);
     std::ifstream actual_file(actual_path);
@@ -1,6 +1,12 @@
 #include <fstream>
 #include <algorithm>
+#include <charconv>
+#include <execution>
+#include <numeric>
 #include "writer.h"
+#include "async-file-io.h"
+#include "cell-ids.h"
+#include "utils.h"
 
 void Writer::write(const OutputData& output_data, const std::string& output_file_path) {
     using CellResult = std::pair<std::string, ValueType>;
@@ -34,8 +40,108 @@ void Writer::write(const OutputData& output_data, const std::string& output_file
         std::cout << "Cannot open the file " << output_file_path << std::endl;
     }
     for (const auto& it : v) {
-        output_file << it.first << " = " << it.second << std::endl;
+        if (it.second == kReferenceError) {
+            output_file << it.first << " = #REF!" << std::endl;
+        } else {
+            output_file << it.first << " = " << it.second << std::endl;
+        }
     }
     output_file.close();
 }
 
+
+void Writer::append_value(std::string& buffer, ValueType value) {
+    char digits[16];
+    buffer += " = ";
+    if (value == kReferenceError) {
+        buffer += "#REF!\n";
+        return;
+    }
+    buffer.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+    buffer += '\n';
+}
+
+void Writer::append_line(std::string& buffer, const std::string& name, ValueType value) {
+    buffer += name;
+    append_value(buffer, value);
+}
+
+// Column letter in high bits, row number in low bits: the same order as comparator of write() has.
+static uint64_t sort_key(const std::string& name) {
+    uint32_t row = 0;
+    std::from_chars(name.data() + 1, name.data() + name.size(), row);
+    return (uint64_t) (unsigned char) name[0] << 32 | row;
+}
+
+std::size_t Writer::write_parallel(const OutputData& output_data, const std::string& output_file_path) {
+    struct CellResult {
+        uint64_t key;
+        ValueType value;
+        const std::string* name;
+    };
+    std::vector<CellResult> v;
+    v.reserve(output_data.size());
+    for (const auto& it : output_data) {
+        v.push_back({ sort_key(it.first), it.second, &it.first });
+    }
+    std::sort(std::execution::par_unseq, v.begin(), v.end(), [](const CellResult& a, const CellResult& b) {
+        return a.key != b.key ? a.key < b.key : a.value < b.value;
+    });
+
+    return write_buffers(format_lines(v.size(), [&](std::size_t i, std::string& buffer) {
+        append_line(buffer, *v[i].name, v[i].value);
+    }), output_file_path);
+}
+
+std::size_t Writer::write_ordered(const std::vector<int>& order, const CellIds& ids, const std::vector<ValueType>& values,
+                                  const std::string& output_file_path) {
+    return write_buffers(format_ordered(order, ids, values), output_file_path);
+}
+
+uint64_t Writer::write_ordered_async(const std::vector<int>& order, const CellIds& ids, const std::vector<ValueType>& values,
+                                     const std::string& output_file_path, AsyncFileIO& io) {
+    return io.WriteFile(output_file_path, format_ordered(order, ids, values), false);
+}
+
+std::vector<std::string> Writer::format_ordered(const std::vector<int>& order, const CellIds& ids,
+                                                const std::vector<ValueType>& values) {
+    return format_lines(order.size(), [&](std::size_t i, std::string& buffer) {
+        int cell = order[i];
+        ids.AppendName(cell, buffer);
+        append_value(buffer, values[cell]);
+    });
+}
+
+template <typename LineWriter>
+std::vector<std::string> Writer::format_lines(std::size_t lines_count, const LineWriter& write_line) {
+    // Every part is formatted into its own buffer. Parts are larger than threads count for load balancing.
+    std::size_t parts_count = std::max<std::size_t>(1, std::min<std::size_t>(get_threads_count() * 4, lines_count / 4096));
+    std::vector<std::string> buffers(parts_count);
+    std::vector<int> parts(parts_count);
+    std::iota(parts.begin(), parts.end(), 0);
+    std::for_each(std::execution::par_unseq, parts.begin(), parts.end(), [&](int part) {
+        std::size_t begin = lines_count * part / parts_count;
+        std::size_t end = lines_count * (part + 1) / parts_count;
+        std::string& buffer = buffers[part];
+        buffer.reserve((end - begin) * 24);
+        for (std::size_t i = begin; i < end; i++) {
+            write_line(i, buffer);
+        }
+    });
+    return buffers;
+}
+
+std::size_t Writer::write_buffers(const std::vector<std::string>& buffers, const std::string& output_file_path) {
+    std::ofstream output_file(output_file_path, std::ios::binary | std::ios::trunc);
+    if (!output_file.is_open()) {
+        std::cout << "Cannot open the file " << output_file_path << std::endl;
+        return 0;
+    }
+    std::size_t size = 0;
+    for (const auto& it : buffers) {
+        output_file.write(it.data(), it.size());
+        size += it.size();
+    }
+    output_file.close();
+    return size;
+}
@@ -1,12 +1,43 @@
 #ifndef SPREADSHEETENGINE_WRITER_H
 #define SPREADSHEETENGINE_WRITER_H
 
+#include <cstdint>
 #include <iostream>
+#include <vector>
 #include "io-data.h"
 
+class AsyncFileIO;
+class CellIds;
+
 class Writer {
 public:
     static void write(const OutputData& output_data, const std::string& output_file_path);
+
+    // Writes the same file as write(). Order is found by precomputed sort keys, lines are formatted by std::to_chars
+    // into per-thread buffers in parallel and the file is written by a few large writes. Returns the file size.
+    static std::size_t write_parallel(const OutputData& output_data, const std::string& output_file_path);
+
+    // Writes cells in the given order without sorting, only formatting is done. 'order' contains ids of cells,
+    // names are restored by 'ids' and values[id] is value of the cell. Returns the file size.
+    static std::size_t write_ordered(const std::vector<int>& order, const CellIds& ids, const std::vector<ValueType>& values,
+                                     const std::string& output_file_path);
+
+    // The same as write_ordered(), but only formatting is done before return, formatted buffers are written by 'io'.
+    // Returns the request of 'io'.
+    static uint64_t write_ordered_async(const std::vector<int>& order, const CellIds& ids, const std::vector<ValueType>& values,
+                                        const std::string& output_file_path, AsyncFileIO& io);
+
+private:
+    static void append_value(std::string& buffer, ValueType value);
+    static void append_line(std::string& buffer, const std::string& name, ValueType value);
+
+    static std::vector<std::string> format_ordered(const std::vector<int>& order, const CellIds& ids,
+                                                   const std::vector<ValueType>& values);
+
+    // Lines are formatted by write_line(i, buffer) in parallel, buffers contain lines in order of i.
+    template <typename LineWriter>
+    static std::vector<std::string> format_lines(std::size_t lines_count, const LineWriter& write_line);
+    static std::size_t write_buffers(const std::vector<std::string>& buffers, const std::string& output_file_path);
 };
 
 #endif //SPREADSHEETENGINE_WRITER_H